@@ -0,0 +1,164 @@
+#include "asset_loader.h"
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool read_scene_manifest(const std::string &filename, std::vector<SceneEntry> &entries)
+{
+    std::ifstream manifest(filename);
+    if (!manifest.is_open())
+    {
+        std::cout << "Cannot open scene manifest " << filename << std::endl;
+        return false;
+    }
+
+    size_t slash = filename.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(manifest, line))
+    {
+        line_number++;
+        std::istringstream in(line);
+        SceneEntry entry = {"", {0, 0, 0}, 1.0f, -1};
+        if (!(in >> entry.filename) || entry.filename[0] == '#')
+            continue;
+
+        // Position, scale and parent are optional; a partial position or a field that isn't
+        // a number is an error. A '#' ends the line.
+        std::vector<std::string> fields;
+        std::string field;
+        while (in >> field && field[0] != '#')
+            fields.push_back(field);
+
+        auto parse = [](const std::string &text, auto &value)
+        {
+            std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+            return result.ec == std::errc() && result.ptr == text.data() + text.size();
+        };
+        bool valid = fields.empty() || (fields.size() >= 3 && fields.size() <= 5);
+        for (size_t i = 0; valid && i < fields.size() && i < 4; i++)
+            valid = parse(fields[i], i < 3 ? entry.position[i] : entry.scale);
+        int parent = 0;
+        if (valid && fields.size() == 5)
+            valid = parse(fields[4], parent);
+        if (!valid)
+        {
+            std::cout << filename << ":" << line_number << ": expected <file> [x y z [scale [parent]]]" << std::endl;
+            return false;
+        }
+
+        if (fields.size() == 5)
+        {
+            if (parent < 1 || parent > (int)entries.size())
+            {
+                std::cout << filename << ":" << line_number << ": parent must be the number of an earlier model" << std::endl;
+                return false;
+            }
+            entry.parent = parent - 1;
+        }
+
+        if (entry.filename[0] != '/' && entry.filename.compare(0, strlen(EMBEDDED_MESH_PREFIX), EMBEDDED_MESH_PREFIX) != 0)
+            entry.filename = directory + entry.filename;
+        entries.push_back(entry);
+    }
+
+    return true;
+}
+
+std::vector<SceneEntry> layout_scene(const std::vector<std::string> &filenames)
+{
+    std::vector<SceneEntry> entries;
+    int count = (int)filenames.size();
+    int side = (int)std::ceil(std::sqrt((double)count));
+    float cell = 2.0f / side;
+
+    for (int i = 0; i < count; i++)
+    {
+        SceneEntry entry = {filenames[i], {0, 0, 0}, 1.0f, -1};
+        if (count > 1)
+        {
+            entry.position[0] = -1.0f + cell * (i % side + 0.5f);
+            entry.position[1] = 1.0f - cell * (i / side + 0.5f);
+            entry.scale = cell * 0.5f;
+        }
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+AssetLoader::~AssetLoader()
+{
+    for (std::thread &thread : workers)
+        thread.join();
+}
+
+void AssetLoader::start(const std::vector<std::string> &files, unsigned thread_count)
+{
+    filenames = files;
+    if (thread_count == 0)
+        thread_count = 1;
+    if (thread_count > filenames.size())
+        thread_count = (unsigned)filenames.size();
+
+    for (unsigned i = 0; i < thread_count; i++)
+        workers.emplace_back(&AssetLoader::worker, this);
+}
+
+void AssetLoader::worker()
+{
+    for (;;)
+    {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (next_file == filenames.size())
+                return;
+            index = next_file++;
+        }
+
+        LoadedMesh loaded;
+        loaded.index = index;
+        loaded.mesh = load_mesh(filenames[index]);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(std::move(loaded));
+        }
+        finished_signal.notify_one();
+    }
+}
+
+void AssetLoader::poll(std::vector<LoadedMesh> &ready)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (LoadedMesh &loaded : finished)
+        ready.push_back(std::move(loaded));
+    delivered += finished.size();
+    finished.clear();
+}
+
+bool AssetLoader::wait(LoadedMesh &loaded)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (delivered == filenames.size())
+        return false;
+
+    finished_signal.wait(lock, [this] { return !finished.empty(); });
+    loaded = std::move(finished.back());
+    finished.pop_back();
+    delivered++;
+    return true;
+}
+
+bool AssetLoader::done()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return delivered == filenames.size();
+}
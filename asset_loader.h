@@ -0,0 +1,69 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh.h"
+
+// One model placed in the scene: which mesh file and where it sits. A model attached to
+// a parent (an earlier entry) is positioned in the parent's frame and moves with it.
+struct SceneEntry
+{
+    std::string filename;
+    float position[3];
+    float scale;
+    int parent; // index into the entry list, -1 for a free-standing model
+};
+
+// Reads a scene manifest: one "<vertex_file> [x y z [scale [parent]]]" per line, '#' comments.
+// parent is the 1-based number of an earlier model in the manifest.
+// Relative paths are resolved against the manifest's directory; embedded mesh names are kept as-is.
+bool read_scene_manifest(const std::string &filename, std::vector<SceneEntry> &entries);
+
+// Places models given on the command line: a single one stays at the origin,
+// several are laid out on a grid filling the default view
+std::vector<SceneEntry> layout_scene(const std::vector<std::string> &filenames);
+
+// A mesh that finished loading, with its position in the list given to start()
+struct LoadedMesh
+{
+    size_t index;
+    Mesh mesh;
+};
+
+// Runs load_mesh() for a list of files on a pool of worker threads. The GL thread keeps
+// initializing meanwhile and collects each mesh as it finishes, to upload it right away.
+struct AssetLoader
+{
+    AssetLoader() = default;
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+    ~AssetLoader();
+
+    void start(const std::vector<std::string> &filenames, unsigned thread_count);
+
+    // Moves every mesh finished since the last call into ready without blocking
+    void poll(std::vector<LoadedMesh> &ready);
+
+    // Blocks until the next mesh finishes. Returns false once every mesh was handed out.
+    bool wait(LoadedMesh &loaded);
+
+    bool done();
+
+private:
+    std::vector<std::string> filenames;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable finished_signal;
+    std::vector<LoadedMesh> finished;
+    size_t next_file = 0;
+    size_t delivered = 0;
+
+    void worker();
+};
+
+#endif
@@ -0,0 +1,698 @@
+// Microbenchmarks of the hot paths outside the interactive window, built and run by
+// `make bench`:
+//
+//   bench [results.json]
+//
+// Progress goes to stdout, the results to results.json (default dist/bench.json) as one
+// JSON document: the machine description plus, per benchmark, its parameters and the
+// median and fastest time of one operation over BENCH_SAMPLES samples.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Linmath
+#include "deps/linmath.h"
+
+#include "mesh.h"
+#include "transform_batch.h"
+#include "scene_graph.h"
+#include "bvh.h"
+#include "headless.h"
+#include "program_cache.h"
+#include "mesh_arena.h"
+#include "render_queue.h"
+
+// Each benchmark repeats its operation until one sample takes at least this long, then
+// takes BENCH_SAMPLES such samples
+static const double BENCH_MIN_SAMPLE_MS = 20.0;
+static const int BENCH_SAMPLES = 7;
+
+struct BenchResult
+{
+    std::string name;
+    std::string params;  // JSON object members, e.g. "\"vertices\": 1000"
+    long iterations;     // operations per sample
+    double median_ns;    // per operation
+    double min_ns;
+    double items;        // processed per operation
+    std::string item_unit;
+    double bytes;        // processed per operation, 0 when not meaningful
+};
+
+static std::vector<BenchResult> results;
+
+// Keeps results the compiler could otherwise prove unused
+static volatile float sink;
+
+// Calibrates and samples time_batch, which performs count operations and returns the
+// nanoseconds they took, and records the result
+static void measure(const std::string &name, const std::string &params, double items, const std::string &item_unit,
+                    double bytes, const std::function<double(long)> &time_batch)
+{
+    time_batch(1);
+    long iterations = 1;
+    while (time_batch(iterations) < BENCH_MIN_SAMPLE_MS * 1e6 && iterations < (1l << 30))
+        iterations *= 2;
+
+    std::vector<double> samples;
+    for (int i = 0; i < BENCH_SAMPLES; i++)
+        samples.push_back(time_batch(iterations) / iterations);
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result = {name, params, iterations, samples[BENCH_SAMPLES / 2], samples[0], items, item_unit, bytes};
+    results.push_back(result);
+
+    std::cout << name << " {" << params << "}: " << result.median_ns << " ns (min " << result.min_ns << " ns), "
+              << items / result.median_ns * 1e3 << " M" << item_unit << "/s";
+    if (bytes > 0)
+        std::cout << ", " << bytes / result.median_ns * 1e3 << " MB/s";
+    std::cout << std::endl;
+}
+
+static void run(const std::string &name, const std::string &params, double items, const std::string &item_unit,
+                double bytes, const std::function<void()> &operation)
+{
+    measure(name, params, items, item_unit, bytes, [&](long count)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (long i = 0; i < count; i++)
+                    operation();
+                return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            });
+}
+
+static std::string param(const std::string &key, double value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "\"%s\": %.10g", key.c_str(), value);
+    return text;
+}
+
+static std::string param(const std::string &key, const std::string &value)
+{
+    return "\"" + key + "\": \"" + value + "\"";
+}
+
+static std::string json_string(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+static bool write_json(const std::string &filename, const std::string &gl_renderer)
+{
+    FILE *out = fopen(filename.c_str(), "w");
+    if (!out)
+    {
+        std::cout << "Cannot write " << filename << std::endl;
+        return false;
+    }
+
+    fprintf(out, "{\n  \"machine\": {\"threads\": %u, \"transform_isa\": \"%s\", \"gl_renderer\": %s},\n",
+            std::thread::hardware_concurrency(), transform_batch_isa(), json_string(gl_renderer).c_str());
+    fprintf(out, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"params\": {%s}, \"iterations\": %ld, \"median_ns\": %.6g, \"min_ns\": %.6g, "
+                     "\"%s_per_second\": %.6g",
+                r.name.c_str(), r.params.c_str(), r.iterations, r.median_ns, r.min_ns, r.item_unit.c_str(), r.items / r.median_ns * 1e9);
+        if (r.bytes > 0)
+            fprintf(out, ", \"bytes_per_second\": %.6g", r.bytes / r.median_ns * 1e9);
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+// Unindexed triangle list of a side x side grid of quads over [-1, 1], colored by height
+// like a terrain, so neighbouring triangles share vertices exactly as in the vertex files
+static Mesh grid_mesh(int side)
+{
+    Mesh mesh;
+    mesh.vertex_count = side * side * 6;
+    mesh.vertices.reserve((size_t)mesh.vertex_count * VERTEX_SIZE);
+    const int corners[6][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1}};
+    for (int y = 0; y < side; y++)
+    {
+        for (int x = 0; x < side; x++)
+        {
+            for (const int *corner : corners)
+            {
+                float px = -1.0f + 2.0f * (x + corner[0]) / side;
+                float py = -1.0f + 2.0f * (y + corner[1]) / side;
+                float height = 0.1f * std::sin(px * 5.0f) * std::cos(py * 3.0f);
+                mesh.vertices.insert(mesh.vertices.end(), {px, py, height, 0.5f + height, 0.6f, 0.4f - height});
+            }
+        }
+    }
+    mesh.compute_bounds();
+    return mesh;
+}
+
+// Writes mesh as a vertex file of "x y z r g b" lines; returns its size in bytes
+static long write_vertex_file(const std::string &filename, const Mesh &mesh)
+{
+    FILE *out = fopen(filename.c_str(), "w");
+    if (!out)
+        return 0;
+    const GLfloat *v = mesh.data();
+    for (GLsizei i = 0; i < mesh.vertex_count; i++, v += VERTEX_SIZE)
+        fprintf(out, "%.6f %.6f %.6f %.4f %.4f %.4f\n", v[0], v[1], v[2], v[3], v[4], v[5]);
+    long size = ftell(out);
+    fclose(out);
+    return size;
+}
+
+static void bench_read_vertices(const std::string &directory)
+{
+    for (int side : {16, 64, 256, 512})
+    {
+        Mesh source = grid_mesh(side);
+        std::string filename = directory + "/bench_vertices_" + std::to_string(side) + ".txt";
+        long bytes = write_vertex_file(filename, source);
+        if (bytes == 0)
+        {
+            std::cout << "Cannot write " << filename << std::endl;
+            continue;
+        }
+
+        run("read_vertices", param("vertices", source.vertex_count), source.vertex_count, "vertices", bytes, [&]
+            {
+                Mesh mesh = read_vertices(filename);
+                sink = mesh.vertices.empty() ? 0 : mesh.vertices[0];
+            });
+        remove(filename.c_str());
+    }
+}
+
+static void bench_linmath()
+{
+    // build_view_projection: ortho, look-at, camera orbit and the products between them
+    run("linmath_view_projection", "", 1, "matrices", 0, []
+        {
+            mat4x4 m, v, p, eye_translation, mvp;
+            mat4x4_identity(m);
+            mat4x4_identity(v);
+            mat4x4_ortho(p, -1.33f - sink, 1.33f + sink, -1.0f, 1.0f, 100.f, -100.f);
+            vec3 eye = {0.f, 0.f, 1.f}, center = {0.f, 0.f, 0.f}, up = {0.f, 1.f, 0.f};
+            mat4x4_look_at(v, eye, center, up);
+            mat4x4_rotate_Y(m, m, 0.3f);
+            mat4x4_translate(eye_translation, -eye[0], -eye[1], -eye[2]);
+            mat4x4_mul(m, m, eye_translation);
+            mat4x4_rotate_X(m, m, 0.1f);
+            mat4x4_rotate_Y(m, m, 0.2f);
+            mat4x4_rotate_Z(m, m, 0.3f);
+            mat4x4_translate(eye_translation, eye[0], eye[1], eye[2]);
+            mat4x4_mul(m, m, eye_translation);
+            mat4x4_mul(v, v, m);
+            mat4x4_mul(mvp, p, v);
+            sink = mvp[3][3];
+        });
+
+    // build_model_rotation: three rotations composed onto the identity, then the placement
+    run("linmath_model_rotation", "", 1, "matrices", 0, []
+        {
+            mat4x4 rotation, placement, model;
+            mat4x4_identity(rotation);
+            mat4x4_rotate_X(rotation, rotation, 0.4f + sink);
+            mat4x4_rotate_Y(rotation, rotation, 0.5f);
+            mat4x4_rotate_Z(rotation, rotation, 0.6f);
+            mat4x4_translate(placement, 0.5f, -0.5f, 0.0f);
+            mat4x4_mul(model, placement, rotation);
+            sink = model[3][0];
+        });
+
+    // Fleet matrices: per-object linmath against the batched composers
+    for (int count : {1000, 10000})
+    {
+        TransformBatch batch;
+        batch.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            batch.rotation_x[i] = 0.001f * i;
+            batch.rotation_y[i] = 0.002f * i;
+            batch.rotation_z[i] = 0.003f * i;
+            batch.translation_x[i] = batch.translation_y[i] = batch.translation_z[i] = 0.1f;
+            batch.scale[i] = 0.5f;
+        }
+        std::vector<mat4x4> out(count);
+        mat4x4 view_projection;
+        mat4x4_identity(view_projection);
+
+        run("transforms_linmath", param("objects", count), count, "matrices", 0, [&]
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    mat4x4 &m = out[i];
+                    mat4x4_translate(m, batch.translation_x[i], batch.translation_y[i], batch.translation_z[i]);
+                    mat4x4_rotate_X(m, m, batch.rotation_x[i]);
+                    mat4x4_rotate_Y(m, m, batch.rotation_y[i]);
+                    mat4x4_rotate_Z(m, m, batch.rotation_z[i]);
+                    mat4x4_scale_aniso(m, m, batch.scale[i], batch.scale[i], batch.scale[i]);
+                    mat4x4_mul(m, view_projection, m);
+                }
+                sink = out[count - 1][3][0];
+            });
+        run("transforms_batch_scalar", param("objects", count), count, "matrices", 0, [&]
+            {
+                compose_transforms_scalar(batch, &view_projection, out.data());
+                sink = out[count - 1][3][0];
+            });
+        run("transforms_batch", param("objects", count) + ", " + param("isa", transform_batch_isa()), count, "matrices", 0, [&]
+            {
+                compose_transforms(batch, &view_projection, out.data());
+                sink = out[count - 1][3][0];
+            });
+    }
+}
+
+static void bench_indexing()
+{
+    for (int side : {32, 128, 256})
+    {
+        Mesh source = grid_mesh(side);
+        run("index_mesh", param("triangles", source.vertex_count / 3), source.vertex_count, "vertices", 0, [&]
+            {
+                Mesh mesh;
+                mesh.vertices = source.vertices;
+                mesh.vertex_count = source.vertex_count;
+                index_mesh(mesh);
+                sink = (float)mesh.index_count;
+            });
+    }
+
+    Mesh indexed = grid_mesh(128);
+    index_mesh(indexed);
+    run("simplify_mesh", param("triangles", indexed.index_count / 3) + ", " + param("target_ratio", 0.25),
+        indexed.index_count / 3, "triangles", 0, [&]
+        {
+            std::vector<GLuint> simplified = simplify_mesh(indexed.data(), indexed.vertex_count, indexed.index_data(),
+                                                           indexed.index_count, indexed.index_count / 4);
+            sink = (float)simplified.size();
+        });
+}
+
+static void bench_scene()
+{
+    // Flat fleet of models under one root, all moved every frame
+    for (int count : {1000, 10000})
+    {
+        SceneGraph graph;
+        int root = graph.add_node(-1);
+        for (int i = 1; i < count; i++)
+            graph.add_node(root);
+        mat4x4 local;
+        mat4x4_identity(local);
+
+        run("scene_graph_update", param("nodes", count), count, "nodes", 0, [&]
+            {
+                local[3][0] += 1e-6f;
+                graph.set_local(root, local);
+                sink = (float)graph.update();
+            });
+    }
+
+    for (int count : {1000, 10000})
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+        std::vector<Aabb> bounds(count);
+        for (Aabb &box : bounds)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                box.min[axis] = position(random);
+                box.max[axis] = box.min[axis] + 0.2f;
+            }
+        }
+
+        Bvh bvh;
+        run("bvh_build", param("items", count), count, "items", 0, [&]
+            {
+                bvh.build(bounds);
+                sink = (float)bvh.nodes.size();
+            });
+
+        run("bvh_refit", param("items", count), count, "items", 0, [&]
+            {
+                for (int i = 0; i < count; i++)
+                    bvh.update(i, bounds[i]);
+                bvh.refit();
+                sink = bvh.nodes[0].bounds.min[0];
+            });
+
+        // A view onto roughly a quarter of the volume
+        mat4x4 projection, view, view_projection;
+        mat4x4_ortho(projection, -5.0f, 5.0f, -5.0f, 5.0f, -20.0f, 20.0f);
+        mat4x4_translate(view, -5.0f, -5.0f, 0.0f);
+        mat4x4_mul(view_projection, projection, view);
+        Frustum frustum;
+        extract_frustum(frustum, view_projection);
+        std::vector<uint32_t> visible;
+        run("bvh_cull", param("items", count), count, "items", 0, [&]
+            {
+                visible.clear();
+                bvh.cull(frustum, visible);
+                sink = (float)visible.size();
+            });
+    }
+}
+
+// Filling and sorting a frame's render queue: draws spread over 4 programs, a quarter as many
+// meshes as draws and 4 levels, at random depths. std::sort of a copy of the same keys for
+// scale (the queue itself uses it below RADIX_SORT_MIN_DRAWS).
+static void bench_render_queue()
+{
+    for (int count : {500, 2000, 10000})
+    {
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+        std::vector<uint64_t> keys(count);
+        for (int i = 0; i < count; i++)
+            keys[i] = render_key(false, random() % 4, random() % (count / 4), random() % 4, depth(random));
+
+        RenderQueue queue;
+        RenderItem item = {};
+        run("render_queue_sort", param("draws", count), count, "draws", 0, [&]
+            {
+                queue.clear();
+                for (uint64_t key : keys)
+                    queue.push(key, item);
+                queue.sort();
+                sink = (float)queue.sorted(0).index_count;
+            });
+
+        std::vector<uint64_t> sorted;
+        run("std_sort_keys", param("draws", count), count, "draws", 0, [&]
+            {
+                sorted = keys;
+                std::sort(sorted.begin(), sorted.end());
+                sink = (float)sorted[0];
+            });
+    }
+}
+
+static const GLchar *BENCH_VERTEX_SHADER = "#version 330 core\n"
+                                           "uniform mat4 mvp;\n"
+                                           "in vec3 position;\n"
+                                           "in vec3 color_in;\n"
+                                           "out vec3 color;\n"
+                                           "void main()\n"
+                                           "{\n"
+                                           "gl_Position = mvp * vec4(position, 1.0);\n"
+                                           "color = color_in;\n"
+                                           "}\0";
+
+static const GLchar *BENCH_FRAGMENT_SHADER = "#version 330 core\n"
+                                             "in vec3 color;\n"
+                                             "out vec4 color_out;\n"
+                                             "void main()\n"
+                                             "{\n"
+                                             "color_out = vec4(color, 1.0);\n"
+                                             "}\n\0";
+
+// Per-draw matrix as an attribute: from a buffer indexed by base_instance for multi-draw,
+// from a constant value set before each draw otherwise
+static const GLchar *BENCH_ARENA_VERTEX_SHADER = "#version 330 core\n"
+                                                 "in vec3 position;\n"
+                                                 "in vec3 color_in;\n"
+                                                 "in mat4 draw_model;\n"
+                                                 "out vec3 color;\n"
+                                                 "void main()\n"
+                                                 "{\n"
+                                                 "gl_Position = draw_model * vec4(position, 1.0);\n"
+                                                 "color = color_in;\n"
+                                                 "}\0";
+
+// BENCH_DISTINCT_MESHES different meshes, each drawn once per frame with its own matrix:
+// from their own buffers (a VAO switch per draw), from one arena with a base-vertex draw per
+// mesh (the GL 3.3 path), and from the arena as a single glMultiDrawElementsIndirect.
+// The meshes are a few triangles each, so the CPU side of the submission dominates.
+static const int BENCH_DISTINCT_MESHES = 1000;
+
+static void bench_distinct_meshes(const std::string &cache_dir, GLuint separate_program, GLint mvp_location)
+{
+    GLuint program = load_program(BENCH_ARENA_VERTEX_SHADER, BENCH_FRAGMENT_SHADER, cache_dir);
+    if (!program)
+        return;
+
+    std::vector<Mesh> meshes;
+    std::vector<mat4x4> matrices(BENCH_DISTINCT_MESHES);
+    size_t vertex_count = 0, index_count = 0;
+    for (int i = 0; i < BENCH_DISTINCT_MESHES; i++)
+    {
+        meshes.push_back(grid_mesh(1 + i % 4));
+        index_mesh(meshes.back());
+        vertex_count += meshes.back().vertex_count;
+        index_count += meshes.back().index_count;
+        mat4x4_translate(matrices[i], -0.9f + 1.8f * (i % 32) / 32, -0.9f + 1.8f * (i / 32 % 32) / 32, 0.0f);
+        mat4x4_scale_aniso(matrices[i], matrices[i], 0.03f, 0.03f, 0.03f);
+    }
+
+    auto bind_vertices = [](GLint position_location, GLint color_location)
+    {
+        glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (GLvoid *)0);
+        glEnableVertexAttribArray(position_location);
+        glVertexAttribPointer(color_location, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (GLvoid *)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(color_location);
+    };
+
+    // Separate buffers and a VAO per mesh
+    std::vector<GLuint> vaos(meshes.size()), buffers(meshes.size() * 2);
+    glGenVertexArrays((GLsizei)vaos.size(), vaos.data());
+    glGenBuffers((GLsizei)buffers.size(), buffers.data());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        glBindVertexArray(vaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[i * 2]);
+        glBufferData(GL_ARRAY_BUFFER, meshes[i].byte_size(), meshes[i].data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[i * 2 + 1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshes[i].index_byte_size(), meshes[i].index_data(), GL_STATIC_DRAW);
+        bind_vertices(glGetAttribLocation(separate_program, "position"), glGetAttribLocation(separate_program, "color_in"));
+    }
+
+    // The same meshes in one arena, plus a command and a matrix per draw
+    MeshArena arena;
+    arena.init(VERTEX_SIZE * sizeof(GLfloat), (GLuint)vertex_count, (GLuint)index_count);
+    std::vector<DrawElementsIndirectCommand> commands;
+    for (const Mesh &mesh : meshes)
+    {
+        ArenaRange range;
+        arena.allocate(range, mesh.vertex_count, mesh.index_count);
+        arena.write(range, mesh.data(), mesh.index_data());
+        commands.push_back({range.index_count, 1, range.first_index, range.base_vertex, (GLuint)commands.size()});
+    }
+    GLuint arena_vao, command_buffer, matrix_buffer;
+    glGenVertexArrays(1, &arena_vao);
+    glGenBuffers(1, &command_buffer);
+    glGenBuffers(1, &matrix_buffer);
+    glBindVertexArray(arena_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, arena.VBO);
+    bind_vertices(glGetAttribLocation(program, "position"), glGetAttribLocation(program, "color_in"));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.EBO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, matrix_buffer);
+    glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(mat4x4), matrices.data(), GL_STATIC_DRAW);
+    GLint draw_model_location = glGetAttribLocation(program, "draw_model");
+    for (int column = 0; column < 4; column++)
+    {
+        glVertexAttribPointer(draw_model_location + column, 4, GL_FLOAT, GL_FALSE, sizeof(mat4x4), (GLvoid *)(sizeof(vec4) * column));
+        glVertexAttribDivisor(draw_model_location + column, 1);
+    }
+    glBindVertexArray(0);
+
+    auto separate = [&]
+    {
+        glUseProgram(separate_program);
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            glBindVertexArray(vaos[i]);
+            glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (const GLfloat *)matrices[i]);
+            glDrawElements(GL_TRIANGLES, meshes[i].index_count, GL_UNSIGNED_INT, 0);
+        }
+    };
+    auto base_vertex = [&]
+    {
+        glUseProgram(program);
+        glBindVertexArray(arena_vao);
+        for (int column = 0; column < 4; column++)
+            glDisableVertexAttribArray(draw_model_location + column);
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            for (int column = 0; column < 4; column++)
+                glVertexAttrib4fv(draw_model_location + column, matrices[i][column]);
+            glDrawElementsBaseVertex(GL_TRIANGLES, commands[i].count, GL_UNSIGNED_INT,
+                                     (GLvoid *)(commands[i].first_index * sizeof(GLuint)), commands[i].base_vertex);
+        }
+    };
+    auto multi_draw = [&]
+    {
+        glUseProgram(program);
+        glBindVertexArray(arena_vao);
+        for (int column = 0; column < 4; column++)
+            glEnableVertexAttribArray(draw_model_location + column);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)commands.size(), 0);
+    };
+
+    std::vector<std::pair<std::string, std::function<void()>>> paths = {{"separate_buffers", separate}, {"arena_base_vertex", base_vertex}};
+    if (multi_draw_indirect_supported())
+        paths.push_back({"multi_draw_indirect", multi_draw});
+    for (const auto &path : paths)
+    {
+        long calls = path.first == "multi_draw_indirect" ? 1 : (long)meshes.size();
+        std::string params = param("meshes", (double)meshes.size()) + ", " + param("draw_calls", (double)calls) + ", " +
+                             param("path", path.first);
+        measure("draw_submit_distinct", params, (double)meshes.size(), "meshes", 0, [&](long count)
+                {
+                    double ns = 0;
+                    for (long i = 0; i < count; i++)
+                    {
+                        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                        auto start = std::chrono::steady_clock::now();
+                        path.second();
+                        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                        glFinish();
+                    }
+                    return ns;
+                });
+    }
+
+    glBindVertexArray(0);
+    glDeleteVertexArrays((GLsizei)vaos.size(), vaos.data());
+    glDeleteBuffers((GLsizei)buffers.size(), buffers.data());
+    glDeleteVertexArrays(1, &arena_vao);
+    glDeleteBuffers(1, &command_buffer);
+    glDeleteBuffers(1, &matrix_buffer);
+    arena.destroy();
+    glDeleteProgram(program);
+}
+
+// Draw submission through a real (offscreen) GL context; returns the renderer name, or an
+// empty string when no context could be created and the benchmarks were skipped
+static std::string bench_draw_submission(const std::string &cache_dir)
+{
+    HeadlessContext headless;
+    if (!init_headless(headless, 800, 600))
+    {
+        std::cout << "draw submission skipped: no headless GL context" << std::endl;
+        return "";
+    }
+    std::string renderer = (const char *)glGetString(GL_RENDERER);
+
+    GLuint program = load_program(BENCH_VERTEX_SHADER, BENCH_FRAGMENT_SHADER, cache_dir);
+    if (!program)
+    {
+        destroy_headless(headless);
+        return renderer;
+    }
+    glUseProgram(program);
+    GLint mvp_location = glGetUniformLocation(program, "mvp");
+    glEnable(GL_DEPTH_TEST);
+
+    Mesh mesh = grid_mesh(8);
+    index_mesh(mesh);
+    GLuint vao, buffers[2];
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(2, buffers);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, mesh.byte_size(), mesh.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.index_byte_size(), mesh.index_data(), GL_STATIC_DRAW);
+    GLint position_location = glGetAttribLocation(program, "position");
+    GLint color_location = glGetAttribLocation(program, "color_in");
+    glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (GLvoid *)0);
+    glEnableVertexAttribArray(position_location);
+    glVertexAttribPointer(color_location, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (GLvoid *)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(color_location);
+
+    // One small mesh drawn many times with its own matrix, as a non-instanced fleet would.
+    // submit only measures the CPU side of the calls; frame includes the GPU via glFinish.
+    for (int draws : {100, 1000})
+    {
+        std::vector<mat4x4> matrices(draws);
+        for (int i = 0; i < draws; i++)
+        {
+            mat4x4_translate(matrices[i], -0.9f + 1.8f * (i % 32) / 32, -0.9f + 1.8f * (i / 32 % 32) / 32, 0.0f);
+            mat4x4_scale_aniso(matrices[i], matrices[i], 0.03f, 0.03f, 0.03f);
+        }
+        auto submit = [&]
+        {
+            for (const mat4x4 &matrix : matrices)
+            {
+                glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (const GLfloat *)matrix);
+                glDrawElements(GL_TRIANGLES, mesh.index_count, GL_UNSIGNED_INT, 0);
+            }
+        };
+
+        // The queue is drained after each frame outside the timed part, so the driver never
+        // throttles the submitting thread
+        measure("draw_submit", param("draws", draws) + ", " + param("triangles_per_draw", mesh.index_count / 3), draws,
+                "draws", 0, [&](long count)
+                {
+                    double ns = 0;
+                    for (long i = 0; i < count; i++)
+                    {
+                        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                        auto start = std::chrono::steady_clock::now();
+                        submit();
+                        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+                        glFinish();
+                    }
+                    return ns;
+                });
+
+        run("draw_frame", param("draws", draws) + ", " + param("triangles_per_draw", mesh.index_count / 3), draws,
+            "draws", 0, [&]
+            {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                submit();
+                glFinish();
+            });
+    }
+
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(2, buffers);
+    bench_distinct_meshes(cache_dir, program, mvp_location);
+    glDeleteProgram(program);
+    destroy_headless(headless);
+    return renderer;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string output = argc > 1 ? argv[1] : "dist/bench.json";
+    size_t slash = output.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : output.substr(0, slash);
+
+    bench_read_vertices(directory);
+    bench_linmath();
+    bench_indexing();
+    bench_scene();
+    bench_render_queue();
+    std::string renderer = bench_draw_submission(directory);
+
+    if (!write_json(output, renderer))
+        return 1;
+    std::cout << "Wrote " << output << std::endl;
+    return 0;
+}
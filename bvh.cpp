@@ -0,0 +1,252 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Items per leaf; a few box tests are cheaper than another level of nodes
+static const uint32_t BVH_LEAF_SIZE = 4;
+
+static const unsigned ALL_PLANES = (1u << 6) - 1;
+
+void transform_aabb(const Aabb &box, mat4x4 matrix, Aabb &out)
+{
+    for (int row = 0; row < 3; row++)
+    {
+        out.min[row] = out.max[row] = matrix[3][row];
+        for (int column = 0; column < 3; column++)
+        {
+            float a = matrix[column][row] * box.min[column];
+            float b = matrix[column][row] * box.max[column];
+            out.min[row] += std::min(a, b);
+            out.max[row] += std::max(a, b);
+        }
+    }
+}
+
+void extract_frustum(Frustum &frustum, mat4x4 mvp)
+{
+    // Row i of the matrix is (mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]); each clip test
+    // -w <= x, y, z <= w gives the plane row3 +- row_i
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            float sign = side == 0 ? 1.0f : -1.0f;
+            float *plane = frustum.planes[axis * 2 + side];
+            for (int column = 0; column < 4; column++)
+                plane[column] = mvp[column][3] + sign * mvp[column][axis];
+
+            float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (length > 0)
+            {
+                for (int i = 0; i < 4; i++)
+                    plane[i] /= length;
+            }
+        }
+    }
+}
+
+static void merge_aabb(Aabb &into, const Aabb &box)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        into.min[axis] = std::min(into.min[axis], box.min[axis]);
+        into.max[axis] = std::max(into.max[axis], box.max[axis]);
+    }
+}
+
+void Bvh::build(const std::vector<Aabb> &bounds)
+{
+    item_bounds = bounds;
+    items.resize(bounds.size());
+    item_leaf.resize(bounds.size());
+    for (uint32_t i = 0; i < items.size(); i++)
+        items[i] = i;
+
+    nodes.clear();
+    nodes.reserve(bounds.size() / BVH_LEAF_SIZE * 2 + 1);
+    if (!items.empty())
+        build_node(0, (uint32_t)items.size(), -1);
+    dirty.assign(nodes.size(), 0);
+}
+
+int32_t Bvh::build_node(uint32_t first, uint32_t count, int32_t parent)
+{
+    int32_t index = (int32_t)nodes.size();
+    nodes.emplace_back();
+    nodes[index].first = first;
+    nodes[index].count = count;
+    nodes[index].right = -1;
+    nodes[index].parent = parent;
+
+    Aabb bounds = item_bounds[items[first]];
+    Aabb centroids;
+    for (int axis = 0; axis < 3; axis++)
+        centroids.min[axis] = centroids.max[axis] = (bounds.min[axis] + bounds.max[axis]) * 0.5f;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const Aabb &box = item_bounds[items[i]];
+        merge_aabb(bounds, box);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float centre = (box.min[axis] + box.max[axis]) * 0.5f;
+            centroids.min[axis] = std::min(centroids.min[axis], centre);
+            centroids.max[axis] = std::max(centroids.max[axis], centre);
+        }
+    }
+    nodes[index].bounds = bounds;
+
+    if (count <= BVH_LEAF_SIZE)
+    {
+        for (uint32_t i = first; i < first + count; i++)
+            item_leaf[items[i]] = index;
+        return index;
+    }
+
+    int axis = 0;
+    for (int candidate = 1; candidate < 3; candidate++)
+    {
+        if (centroids.max[candidate] - centroids.min[candidate] > centroids.max[axis] - centroids.min[axis])
+            axis = candidate;
+    }
+
+    // Median split: balanced depth regardless of how the instances are spread
+    uint32_t half = count / 2;
+    std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+                     [&](uint32_t a, uint32_t b)
+                     {
+                         return item_bounds[a].min[axis] + item_bounds[a].max[axis] <
+                                item_bounds[b].min[axis] + item_bounds[b].max[axis];
+                     });
+
+    build_node(first, half, index);
+    int32_t right = build_node(first + half, count - half, index);
+    nodes[index].right = right;
+    return index;
+}
+
+void Bvh::update(uint32_t item, const Aabb &bounds)
+{
+    item_bounds[item] = bounds;
+    dirty[item_leaf[item]] = 1;
+}
+
+void Bvh::refit()
+{
+    // Children always follow their parent, so walking backwards settles them first
+    for (int32_t index = (int32_t)nodes.size() - 1; index >= 0; index--)
+    {
+        if (!dirty[index])
+            continue;
+        dirty[index] = 0;
+
+        Node &node = nodes[index];
+        if (node.right < 0)
+        {
+            node.bounds = item_bounds[items[node.first]];
+            for (uint32_t i = node.first + 1; i < node.first + node.count; i++)
+                merge_aabb(node.bounds, item_bounds[items[i]]);
+        }
+        else
+        {
+            node.bounds = nodes[index + 1].bounds;
+            merge_aabb(node.bounds, nodes[node.right].bounds);
+        }
+
+        if (node.parent >= 0)
+            dirty[node.parent] = 1;
+    }
+}
+
+// Tests box against the planes in mask; returns false if it lies entirely outside one of
+// them, otherwise reports the planes it crosses in straddled
+static bool touches_frustum(const Aabb &box, const Frustum &frustum, unsigned mask, unsigned &straddled)
+{
+    straddled = 0;
+    for (int p = 0; p < 6; p++)
+    {
+        if (!(mask & (1u << p)))
+            continue;
+
+        const float *plane = frustum.planes[p];
+        float far_distance = plane[3], near_distance = plane[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float low = plane[axis] * box.min[axis];
+            float high = plane[axis] * box.max[axis];
+            far_distance += std::max(low, high);
+            near_distance += std::min(low, high);
+        }
+
+        if (far_distance < 0)
+            return false;
+        if (near_distance < 0)
+            straddled |= 1u << p;
+    }
+
+    return true;
+}
+
+void Bvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible) const
+{
+    if (nodes.empty())
+        return;
+
+    // Each entry carries the planes its box still straddles; planes a parent was
+    // entirely inside of are not tested again below it
+    struct Entry
+    {
+        int32_t node;
+        unsigned planes;
+    };
+    Entry stack[64];
+    int top = 0;
+    stack[top++] = {0, ALL_PLANES};
+
+    while (top > 0)
+    {
+        Entry entry = stack[--top];
+        const Node &node = nodes[entry.node];
+        unsigned straddled;
+        if (!touches_frustum(node.bounds, frustum, entry.planes, straddled))
+            continue;
+
+        if (straddled == 0)
+        {
+            visible.insert(visible.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+        }
+        else if (node.right < 0)
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                unsigned item_straddled;
+                if (touches_frustum(item_bounds[items[i]], frustum, straddled, item_straddled))
+                    visible.push_back(items[i]);
+            }
+        }
+        else
+        {
+            stack[top++] = {node.right, straddled};
+            stack[top++] = {entry.node + 1, straddled};
+        }
+    }
+}
+
+void CullStats::add_frame(long drawn_count, long culled_count, double us)
+{
+    frames++;
+    drawn += drawn_count;
+    culled += culled_count;
+    cull_us += us;
+}
+
+void CullStats::print() const
+{
+    if (frames == 0)
+        return;
+
+    std::cout << "Frustum culling: " << (double)drawn / frames << " instances drawn, "
+              << (double)culled / frames << " culled per frame on average, cull pass "
+              << cull_us / frames << " us per frame" << std::endl;
+}
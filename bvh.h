@@ -0,0 +1,74 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstdint>
+#include <vector>
+
+// Linmath
+#include "deps/linmath.h"
+
+struct Aabb
+{
+    float min[3];
+    float max[3];
+};
+
+// Bounds of box after transforming it by matrix (Arvo's method, exact for affine matrices)
+void transform_aabb(const Aabb &box, mat4x4 matrix, Aabb &out);
+
+// Six clip planes (ax + by + cz + d >= 0 inside), normalized
+struct Frustum
+{
+    vec4 planes[6];
+};
+
+// Extracts the view volume of a column-major model-view-projection matrix (Gribb/Hartmann)
+void extract_frustum(Frustum &frustum, mat4x4 mvp);
+
+// Bounding volume hierarchy over a fixed set of items (scene instances). Nodes are stored
+// in pre-order, so a parent always comes before its children and every subtree covers a
+// contiguous range of `items`. Moving items only updates leaf boxes; refit() then
+// recomputes the flagged leaves and their ancestors bottom-up, without rebuilding.
+struct Bvh
+{
+    struct Node
+    {
+        Aabb bounds;
+        uint32_t first, count; // range in items covered by the subtree
+        int32_t right;         // second child (the first is the next node); -1 for leaves
+        int32_t parent;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> items;     // item indices, permuted so each subtree is contiguous
+    std::vector<Aabb> item_bounds;   // indexed by item
+    std::vector<int32_t> item_leaf;  // leaf node holding each item
+    std::vector<unsigned char> dirty; // per node, set by update()
+
+    // Builds the tree with median splits along the longest axis of the centroids
+    void build(const std::vector<Aabb> &bounds);
+
+    void update(uint32_t item, const Aabb &bounds);
+    void refit();
+
+    // Appends the index of every item whose box touches the frustum. Subtrees entirely
+    // inside are appended without testing their children.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+private:
+    int32_t build_node(uint32_t first, uint32_t count, int32_t parent);
+};
+
+// Per-frame culling counters, see print()
+struct CullStats
+{
+    long frames = 0;
+    long drawn = 0;
+    long culled = 0;
+    double cull_us = 0;
+
+    void add_frame(long drawn_count, long culled_count, double us);
+    void print() const;
+};
+
+#endif
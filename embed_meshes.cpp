@@ -0,0 +1,176 @@
+// Build tool behind `make embedded`: turns vertex files into headers holding the arrays
+// load_mesh() would build from them (indexed, with levels of detail), so the embedded build
+// uploads them straight from the executable without any file I/O or parsing at startup.
+//
+//   embed_meshes <output_dir> <vertex_file>...
+//
+// writes <output_dir>/<name>_mesh.h per file plus <output_dir>/meshes.h, which includes them
+// all and lists them in EMBEDDED_MESH_TABLE. <name> is the file name without its extension,
+// with anything but letters, digits and '_' replaced by '_'.
+
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+// Values per line of the generated arrays
+static const int FLOATS_PER_LINE = VERTEX_SIZE;
+static const int INDICES_PER_LINE = 12;
+
+// Name of the mesh in the generated code and for find_embedded_mesh(), a valid C identifier
+static std::string mesh_name(const std::string &filename)
+{
+    size_t slash = filename.find_last_of('/');
+    std::string name = slash == std::string::npos ? filename : filename.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0)
+        name = name.substr(0, dot);
+
+    for (char &c : name)
+    {
+        if (!isalnum((unsigned char)c))
+            c = '_';
+    }
+    if (name.empty() || isdigit((unsigned char)name[0]))
+        name = "mesh_" + name;
+    return name;
+}
+
+// %.9g round-trips every float exactly
+static void write_float(FILE *out, float value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".e") == std::string::npos)
+        literal += ".0";
+    fprintf(out, "%sf", literal.c_str());
+}
+
+static bool write_mesh_header(const std::string &path, const std::string &source, const std::string &name, const Mesh &mesh)
+{
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out)
+    {
+        std::cout << "Cannot write " << path << std::endl;
+        return false;
+    }
+
+    std::string guard = "EMBEDDED_" + name + "_MESH_H";
+    for (char &c : guard)
+        c = (char)toupper((unsigned char)c);
+
+    fprintf(out, "// Generated by embed_meshes from %s, do not edit: run make embedded\n", source.c_str());
+    fprintf(out, "#ifndef %s\n#define %s\n\n#include \"../mesh.h\"\n\n", guard.c_str(), guard.c_str());
+
+    const GLfloat *vertices = mesh.data();
+    fprintf(out, "// %d vertices: x y z r g b\n", mesh.vertex_count);
+    fprintf(out, "constexpr GLfloat %s_vertices[] = {\n", name.c_str());
+    size_t float_count = (size_t)mesh.vertex_count * VERTEX_SIZE;
+    for (size_t i = 0; i < float_count; i++)
+    {
+        fputs(i % FLOATS_PER_LINE == 0 ? "    " : " ", out);
+        write_float(out, vertices[i]);
+        fputs(",", out);
+        if (i % FLOATS_PER_LINE == FLOATS_PER_LINE - 1 || i + 1 == float_count)
+            fputs("\n", out);
+    }
+    fputs("};\n\n", out);
+
+    const GLuint *indices = mesh.index_data();
+    fprintf(out, "// %d levels of detail back to back\n", mesh.lod_count);
+    fprintf(out, "constexpr GLuint %s_indices[] = {\n", name.c_str());
+    for (GLsizei i = 0; i < mesh.index_count; i++)
+    {
+        fprintf(out, "%s%u,", i % INDICES_PER_LINE == 0 ? "    " : " ", indices[i]);
+        if (i % INDICES_PER_LINE == INDICES_PER_LINE - 1 || i + 1 == mesh.index_count)
+            fputs("\n", out);
+    }
+    fputs("};\n\n", out);
+
+    fprintf(out, "constexpr EmbeddedMesh %s_mesh = {\n", name.c_str());
+    fprintf(out, "    \"%s\",\n    %s_vertices,\n    %d,\n    %s_indices,\n    %d,\n", name.c_str(), name.c_str(),
+            mesh.vertex_count, name.c_str(), mesh.index_count);
+    for (const GLfloat *bounds : {mesh.bounds_min, mesh.bounds_max})
+    {
+        fputs("    {", out);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            write_float(out, bounds[axis]);
+            fputs(axis < 2 ? ", " : "},\n", out);
+        }
+    }
+    fputs("    {", out);
+    for (int level = 0; level < mesh.lod_count; level++)
+    {
+        fprintf(out, "%s{%u, %d, ", level ? ", " : "", mesh.lods[level].index_offset, mesh.lods[level].index_count);
+        write_float(out, mesh.lods[level].error);
+        fputs("}", out);
+    }
+    fprintf(out, "},\n    %d,\n};\n\n#endif\n", mesh.lod_count);
+
+    return fclose(out) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cout << "Usage: embed_meshes <output_dir> <vertex_file>..." << std::endl;
+        return 1;
+    }
+
+    std::string output_dir = argv[1];
+    std::vector<std::string> names;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string source = argv[i];
+        std::string name = mesh_name(source);
+        for (const std::string &other : names)
+        {
+            if (other == name)
+            {
+                std::cout << source << ": another vertex file is already embedded as " << other << std::endl;
+                return 1;
+            }
+        }
+
+        // Same steps as load_mesh() on a cache miss, without writing the cache
+        Mesh mesh = read_vertices(source);
+        if (mesh.vertex_count == 0)
+            return 1;
+        index_mesh(mesh);
+        build_lods(mesh);
+        if (mesh.index_count == 0)
+        {
+            std::cout << source << ": no triangles to embed" << std::endl;
+            return 1;
+        }
+
+        if (!write_mesh_header(output_dir + "/" + name + "_mesh.h", source, name, mesh))
+            return 1;
+        std::cout << "Embedded " << source << " as " << name << ": " << mesh.vertex_count << " vertices, "
+                  << mesh.index_count << " indices" << std::endl;
+        names.push_back(name);
+    }
+
+    std::string path = output_dir + "/meshes.h";
+    FILE *out = fopen(path.c_str(), "w");
+    if (!out)
+    {
+        std::cout << "Cannot write " << path << std::endl;
+        return 1;
+    }
+    fputs("// Generated by embed_meshes, do not edit: run make embedded\n", out);
+    fputs("#ifndef EMBEDDED_MESHES_H\n#define EMBEDDED_MESHES_H\n\n", out);
+    for (const std::string &name : names)
+        fprintf(out, "#include \"%s_mesh.h\"\n", name.c_str());
+    fputs("\n// Every embedded mesh, terminated by nullptr\nconstexpr const EmbeddedMesh *EMBEDDED_MESH_TABLE[] = {\n", out);
+    for (const std::string &name : names)
+        fprintf(out, "    &%s_mesh,\n", name.c_str());
+    fputs("    nullptr,\n};\n\n#endif\n", out);
+    return fclose(out) == 0 ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+#include "fleet.h"
+
+#include <cmath>
+
+// Peak bank angle (radians) and angular speed of the formation's roll
+const float BANK_AMPLITUDE = 0.35f;
+const float BANK_SPEED = 1.5f;
+
+void build_formation(Fleet &fleet, int count)
+{
+    int side = (int)std::ceil(std::sqrt((double)count));
+    float cell = 2.0f / side;
+
+    fleet.transforms.resize(count);
+    fleet.phase.resize(count);
+    fleet.instances.resize(count);
+    fleet.animated = count > 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        Instance &instance = fleet.instances[i];
+        int row = i / side, column = i % side;
+
+        if (count > 1)
+        {
+            fleet.transforms.translation_x[i] = -1.0f + cell * (column + 0.5f);
+            fleet.transforms.translation_y[i] = -1.0f + cell * (row + 0.5f);
+            fleet.transforms.scale[i] = cell * 0.5f;
+        }
+
+        // Cheap deterministic variation between 0.7 and 1.0 per channel
+        unsigned hash = (unsigned)i * 2654435761u;
+        instance.tint[0] = 0.7f + 0.3f * ((hash >> 8) & 0xff) / 255.0f;
+        instance.tint[1] = 0.7f + 0.3f * ((hash >> 16) & 0xff) / 255.0f;
+        instance.tint[2] = 0.7f + 0.3f * ((hash >> 24) & 0xff) / 255.0f;
+        instance.tint[3] = 1.0f;
+        if (count == 1)
+            instance.tint[0] = instance.tint[1] = instance.tint[2] = 1.0f;
+
+        fleet.phase[i] = (float)(row + column) * 0.4f;
+    }
+
+    update_fleet(fleet, 0.0f);
+}
+
+void update_fleet(Fleet &fleet, float time)
+{
+    if (fleet.animated)
+    {
+        for (size_t i = 0; i < fleet.phase.size(); i++)
+            fleet.transforms.rotation_z[i] = BANK_AMPLITUDE * sinf(BANK_SPEED * time + fleet.phase[i]);
+    }
+
+    if (!fleet.instances.empty())
+        compose_transforms(fleet.transforms, nullptr, &fleet.instances[0].model, sizeof(Instance));
+}
@@ -0,0 +1,37 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <vector>
+
+// Linmath
+#include "deps/linmath.h"
+
+#include "transform_batch.h"
+
+// Per-instance data read by the vertex shader through attribute divisors.
+// The model matrix occupies four consecutive vec4 attribute locations.
+struct Instance
+{
+    mat4x4 model;
+    vec4 tint;
+};
+
+// Formation layout and per-aircraft motion. `instances` is what gets uploaded.
+struct Fleet
+{
+    TransformBatch transforms;
+    std::vector<float> phase;
+    std::vector<Instance> instances;
+    bool animated = false;
+};
+
+// Places count aircraft on a square grid filling the default view, each scaled down
+// to fit its cell and tinted slightly differently so neighbours can be told apart.
+// A single aircraft gets the identity transform and a white tint and never moves.
+void build_formation(Fleet &fleet, int count);
+
+// Banks every aircraft by its own phase of a slow roll and recomposes all model
+// matrices with one batched (SIMD) pass straight into the instance array
+void update_fleet(Fleet &fleet, float time);
+
+#endif
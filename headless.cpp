@@ -0,0 +1,125 @@
+#include "headless.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+#include <EGL/eglext.h>
+
+static EGLDisplay get_display()
+{
+    // Prefer the surfaceless platform: it needs neither X11/Wayland nor a DRM device
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (get_platform_display)
+    {
+        EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (display != EGL_NO_DISPLAY)
+            return display;
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool init_headless(HeadlessContext &headless, GLsizei width, GLsizei height)
+{
+    headless.display = get_display();
+    if (headless.display == EGL_NO_DISPLAY || !eglInitialize(headless.display, nullptr, nullptr))
+    {
+        std::cout << "Cannot initialize EGL display" << std::endl;
+        return false;
+    }
+
+    const EGLint config_attributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE};
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        !eglChooseConfig(headless.display, config_attributes, &config, 1, &config_count) || config_count == 0)
+    {
+        std::cout << "No EGL config with desktop OpenGL support" << std::endl;
+        return false;
+    }
+
+    // Same version and profile as the GLFW window
+    const EGLint context_attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE};
+    headless.context = eglCreateContext(headless.display, config, EGL_NO_CONTEXT, context_attributes);
+    if (headless.context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, headless.context))
+    {
+        std::cout << "Cannot create a surfaceless OpenGL 3.3 context (EGL error 0x"
+                  << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+
+    // GLEW may report a missing GLX display here, but the GL entry points still resolve
+    glewExperimental = GL_TRUE;
+    glewInit();
+
+    headless.width = width;
+    headless.height = height;
+
+    glGenRenderbuffers(1, &headless.color_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.color_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &headless.depth_buffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.depth_buffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &headless.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless.framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.color_buffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, headless.depth_buffer);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer is incomplete" << std::endl;
+        return false;
+    }
+
+    std::cout << "Headless renderer: " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")" << std::endl;
+    return true;
+}
+
+void destroy_headless(HeadlessContext &headless)
+{
+    if (headless.context != EGL_NO_CONTEXT)
+    {
+        glDeleteFramebuffers(1, &headless.framebuffer);
+        glDeleteRenderbuffers(1, &headless.color_buffer);
+        glDeleteRenderbuffers(1, &headless.depth_buffer);
+        eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(headless.display, headless.context);
+    }
+    if (headless.display != EGL_NO_DISPLAY)
+        eglTerminate(headless.display);
+
+    headless = HeadlessContext();
+}
+
+void print_frame_stats(std::vector<double> frame_ms, double triangles_per_frame)
+{
+    if (frame_ms.empty())
+        return;
+
+    std::sort(frame_ms.begin(), frame_ms.end());
+    size_t count = frame_ms.size();
+    double total_ms = std::accumulate(frame_ms.begin(), frame_ms.end(), 0.0);
+
+    // Nearest-rank percentiles
+    double median = frame_ms[(count - 1) / 2];
+    double p99 = frame_ms[(size_t)std::ceil(0.99 * count) - 1];
+
+    std::cout << count << " frames: min " << frame_ms.front() << " ms, median " << median
+              << " ms, p99 " << p99 << " ms, max " << frame_ms.back() << " ms" << std::endl;
+    std::cout << "Throughput: " << count * 1000.0 / total_ms << " frames/s, "
+              << triangles_per_frame * count * 1000.0 / total_ms << " triangles/s" << std::endl;
+}
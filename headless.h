@@ -0,0 +1,33 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <EGL/egl.h>
+
+// OpenGL 3.3 core context without a window: EGL (surfaceless on Mesa, so llvmpipe works
+// on machines with no display or GPU) rendering into a framebuffer object
+struct HeadlessContext
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    GLuint framebuffer = 0;
+    GLuint color_buffer = 0;
+    GLuint depth_buffer = 0;
+    GLsizei width = 0;
+    GLsizei height = 0;
+};
+
+// Creates the context, makes it current, initializes GLEW and binds a width x height
+// RGBA8 + depth framebuffer. Prints the reason and returns false on failure.
+bool init_headless(HeadlessContext &headless, GLsizei width, GLsizei height);
+void destroy_headless(HeadlessContext &headless);
+
+// Prints min, median, p99 and max of the frame times plus the triangle throughput
+void print_frame_stats(std::vector<double> frame_ms, double triangles_per_frame);
+
+#endif
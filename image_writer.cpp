@@ -0,0 +1,215 @@
+#include "image_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+#include <zlib.h>
+
+// Rows of the image top to bottom as RGB bytes; for PNG each row is filtered and starts with
+// its filter type byte
+static std::vector<unsigned char> rgb_rows(const uint32_t *pixels, int width, int height, int stride, bool png)
+{
+    size_t row_size = (size_t)width * 3 + (png ? 1 : 0);
+    std::vector<unsigned char> rows(row_size * height);
+    unsigned char *out = rows.data();
+    for (int y = height - 1; y >= 0; y--)
+    {
+        const unsigned char *source = (const unsigned char *)(pixels + (size_t)y * stride);
+        if (png)
+        {
+            // Sub filter: each byte minus the one of the previous pixel, which turns the flat
+            // background and smooth shading into runs of zeros
+            *out++ = 1;
+            for (int x = 0; x < width; x++)
+            {
+                for (int channel = 0; channel < 3; channel++)
+                    *out++ = (unsigned char)(source[x * 4 + channel] - (x > 0 ? source[(x - 1) * 4 + channel] : 0));
+            }
+        }
+        else
+        {
+            for (int x = 0; x < width; x++)
+            {
+                *out++ = source[x * 4];
+                *out++ = source[x * 4 + 1];
+                *out++ = source[x * 4 + 2];
+            }
+        }
+    }
+    return rows;
+}
+
+static void put_u32(std::vector<unsigned char> &out, uint32_t value)
+{
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+static void put_chunk(std::vector<unsigned char> &out, const char *type, const unsigned char *data, size_t size)
+{
+    put_u32(out, (uint32_t)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    put_u32(out, (uint32_t)crc32(0, out.data() + start, (uInt)(out.size() - start)));
+}
+
+static bool encode_png(const std::vector<unsigned char> &rows, int width, int height, std::vector<unsigned char> &out)
+{
+    uLongf compressed_size = compressBound((uLong)rows.size());
+    std::vector<unsigned char> compressed(compressed_size);
+    if (compress2(compressed.data(), &compressed_size, rows.data(), (uLong)rows.size(), Z_BEST_SPEED) != Z_OK)
+        return false;
+
+    // 8-bit truecolor, no interlacing
+    std::vector<unsigned char> header;
+    put_u32(header, width);
+    put_u32(header, height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    out.assign(signature, signature + 8);
+    put_chunk(out, "IHDR", header.data(), header.size());
+    put_chunk(out, "IDAT", compressed.data(), compressed_size);
+    put_chunk(out, "IEND", nullptr, 0);
+    return true;
+}
+
+bool write_image(const std::string &filename, const uint32_t *pixels, int width, int height, int stride)
+{
+    const std::string png_extension = ".png";
+    bool png = filename.size() > png_extension.size() &&
+               filename.compare(filename.size() - png_extension.size(), png_extension.size(), png_extension) == 0;
+
+    std::vector<unsigned char> rows = rgb_rows(pixels, width, height, stride, png);
+    std::vector<unsigned char> encoded;
+    if (png)
+    {
+        if (!encode_png(rows, width, height, encoded))
+        {
+            std::cout << "Cannot compress " << filename << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        char header[32];
+        int header_size = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+        encoded.reserve(header_size + rows.size());
+        encoded.assign(header, header + header_size);
+        encoded.insert(encoded.end(), rows.begin(), rows.end());
+    }
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file)
+    {
+        std::cout << "Cannot write " << filename << std::endl;
+        return false;
+    }
+    bool written = fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+        std::cout << "Cannot write " << filename << std::endl;
+    return written;
+}
+
+ImageWriter::~ImageWriter()
+{
+    finish();
+}
+
+void ImageWriter::start(unsigned thread_count, size_t queue_capacity)
+{
+    capacity = std::max<size_t>(queue_capacity, 1);
+    stopping = false;
+    if (thread_count == 0)
+        thread_count = 1;
+    worker_count = thread_count;
+    for (unsigned i = 0; i < thread_count; i++)
+        workers.emplace_back(&ImageWriter::worker, this);
+}
+
+std::vector<uint32_t> ImageWriter::buffer()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (spare.empty())
+        return std::vector<uint32_t>();
+
+    std::vector<uint32_t> pixels = std::move(spare.back());
+    spare.pop_back();
+    return pixels;
+}
+
+void ImageWriter::write(const std::string &filename, std::vector<uint32_t> pixels, int width, int height)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pending >= capacity)
+    {
+        auto start = std::chrono::steady_clock::now();
+        space_signal.wait(lock, [this] { return pending < capacity; });
+        wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    jobs.push_back(Job{filename, std::move(pixels), width, height});
+    pending++;
+    lock.unlock();
+    job_signal.notify_one();
+}
+
+void ImageWriter::worker()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_signal.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool written = write_image(job.filename, job.pixels.data(), job.width, job.height, job.width);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            images++;
+            failures += written ? 0 : 1;
+            encode_ms += ms;
+            spare.push_back(std::move(job.pixels));
+            pending--;
+        }
+        space_signal.notify_one();
+    }
+}
+
+void ImageWriter::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_signal.notify_all();
+    for (std::thread &thread : workers)
+        thread.join();
+    workers.clear();
+}
+
+void ImageWriter::print_stats() const
+{
+    if (images == 0)
+        return;
+
+    std::cout << "Image writer: " << images << " images on " << worker_count << " threads, "
+              << encode_ms / images << " ms to encode and write each";
+    if (failures > 0)
+        std::cout << ", " << failures << " failed";
+    std::cout << ", render loop waited " << wait_ms << " ms for the queue" << std::endl;
+}
@@ -0,0 +1,67 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes an RGBA8 image whose rows start at the bottom (glReadPixels order) as a binary PPM,
+// or as an RGB PNG when the name ends in ".png". stride is the number of pixels from one row
+// to the next. Prints the reason and returns false on failure.
+bool write_image(const std::string &filename, const uint32_t *pixels, int width, int height, int stride);
+
+// Encodes and writes images on worker threads, so a render loop only hands its pixels over.
+// At most `capacity` images are queued or being encoded at a time; write() blocks beyond
+// that, which bounds memory when encoding falls behind rendering.
+struct ImageWriter
+{
+    // Counters, see print_stats()
+    long images = 0;
+    long failures = 0;
+    double encode_ms = 0; // summed over the workers
+    double wait_ms = 0;   // the caller blocked in write() on a full queue
+
+    ImageWriter() = default;
+    ImageWriter(const ImageWriter &) = delete;
+    ImageWriter &operator=(const ImageWriter &) = delete;
+    ~ImageWriter();
+
+    void start(unsigned thread_count, size_t capacity);
+
+    // Returns an empty pixel buffer, reusing the storage of images already written
+    std::vector<uint32_t> buffer();
+
+    // Queues pixels (width x height, tightly packed, bottom row first) to be written as filename
+    void write(const std::string &filename, std::vector<uint32_t> pixels, int width, int height);
+
+    // Waits for every queued image to be written and stops the workers
+    void finish();
+
+    void print_stats() const;
+
+private:
+    struct Job
+    {
+        std::string filename;
+        std::vector<uint32_t> pixels;
+        int width, height;
+    };
+
+    std::vector<std::thread> workers;
+    unsigned worker_count = 0;
+    std::mutex mutex;
+    std::condition_variable job_signal, space_signal;
+    std::deque<Job> jobs;
+    std::vector<std::vector<uint32_t>> spare;
+    size_t capacity = 0;
+    size_t pending = 0; // queued plus being encoded
+    bool stopping = false;
+
+    void worker();
+};
+
+#endif
@@ -1,41 +1,148 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 // Linmath
 #include "deps/linmath.h"
 
-// GLEW
-#define GLEW_STATIC
-#include <GL/glew.h>
+// Mesh loading (includes GLEW)
+#include "mesh.h"
+
+// Offscreen EGL rendering
+#include "headless.h"
+
+// Frame stage timers and trace export
+#include "profiler.h"
+
+// Instanced aircraft formations
+#include "fleet.h"
+
+// Scene manifests and parallel mesh loading
+#include "asset_loader.h"
+
+// Shader programs with an on-disk binary cache
+#include "program_cache.h"
+
+// Triple-buffered ring for per-frame vertex data
+#include "stream_buffer.h"
+
+// Transform hierarchy of the scene models
+#include "scene_graph.h"
+
+// Frustum culling of instances over a bounding volume hierarchy
+#include "bvh.h"
+
+// Reloading vertex files when they change on disk
+#include "mesh_watcher.h"
+
+// Fixed-timestep simulation of the model and camera controls
+#include "simulation.h"
+
+// Multithreaded software rasterizer for machines without a GPU
+#include "soft_raster.h"
+
+// Scripted offscreen turntables with asynchronous readback
+#include "turntable.h"
+
+// PPM/PNG encoding on worker threads
+#include "image_writer.h"
+
+// Shared vertex/index buffers for multi-draw submission
+#include "mesh_arena.h"
+
+// Sorted draw submission with redundant-state filtering
+#include "render_queue.h"
+
+// Occlusion queries on instance bounding boxes
+#include "occlusion.h"
 
 // GLFW
 #include <GLFW/glfw3.h>
 
 // Function prototypes
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
-void read_vertices(GLfloat *vertices, std::string filename);
 void printHelp();
 GLFWwindow *init();
-GLuint compile_shader(const GLchar *shaderSource, GLenum type);
+void refresh_callback(GLFWwindow *window);
+void update_scene(int width, int height);
+void draw_frame(int width, int height);
+void draw_frame_software(SoftRasterizer &rasterizer);
+void build_view_projection(float ratio);
+void build_model_rotation();
+size_t upload_mesh(size_t slot, const Mesh &mesh);
+void keep_mesh(size_t slot, Mesh &mesh);
+size_t update_buffer(GLenum target, std::vector<unsigned char> &shadow, size_t &capacity, const void *data, size_t size);
+void apply_reloads(MeshWatcher &watcher, const std::vector<std::string> &mesh_files);
+void apply_simulation();
+void bind_vertex_attributes();
+void bind_instance_attributes(GLintptr offset);
+void init_arena();
+void bind_arena_buffers();
+void draw_arena();
+void draw_queue();
+void split_occluded();
+void draw_occluded();
+float model_depth(size_t model);
+void cull_instances();
+void select_lods();
+void report_first_frame(std::chrono::steady_clock::time_point program_start, double init_ms);
+bool render_turntable(const std::vector<TurntablePose> &poses, const std::string &output_pattern,
+                      HeadlessContext &headless, unsigned software_threads);
 
 // Window dimensions
 const GLuint WIDTH = 800, HEIGHT = 600;
 
+// Background of every frame (RGBA)
+const float CLEAR_COLOR[4] = {0.52f, 0.8f, 0.92f, 1.0f};
+
+// Untimed frames rendered before a headless benchmark
+const int HEADLESS_WARMUP_FRAMES = 5;
+
+// Turntable frames in flight between the GPU and the image writer: pixel buffers being
+// read back, then images queued per encoding thread
+const int TURNTABLE_READBACK_SLOTS = 3;
+const int TURNTABLE_IMAGES_PER_THREAD = 2;
+
 // Shaders
 const GLchar *vertexShaderSource = "#version 330 core\n"
                                    "uniform mat4 mvp;\n"
                                    "uniform mat4 rotation_mat;\n"
                                    "in vec3 position;\n"
                                    "in vec3 color_in;\n"
+                                   "in mat4 instance_model;\n"
+                                   "in vec4 instance_tint;\n"
                                    "out vec3 color;\n"
                                    "void main()\n"
                                    "{\n"
-                                   "gl_Position = mvp * rotation_mat * vec4(position, 1.0);\n"
-                                   "color = color_in;\n"
+                                   "gl_Position = mvp * instance_model * rotation_mat * vec4(position, 1.0);\n"
+                                   "color = color_in * instance_tint.rgb;\n"
                                    "}\0";
 
+// Multi-draw variant: the model matrix comes per draw (draw_model, draw_first) and the draw's
+// instances are fetched from the instance stream, viewed as a buffer texture of 5 texels each
+const GLchar *arenaVertexShaderSource = "#version 330 core\n"
+                                        "uniform mat4 mvp;\n"
+                                        "uniform samplerBuffer instances;\n"
+                                        "in vec3 position;\n"
+                                        "in vec3 color_in;\n"
+                                        "in mat4 draw_model;\n"
+                                        "in int draw_first;\n"
+                                        "out vec3 color;\n"
+                                        "void main()\n"
+                                        "{\n"
+                                        "int texel = draw_first + gl_InstanceID * 5;\n"
+                                        "mat4 instance_model = mat4(texelFetch(instances, texel), texelFetch(instances, texel + 1),\n"
+                                        "                           texelFetch(instances, texel + 2), texelFetch(instances, texel + 3));\n"
+                                        "gl_Position = mvp * instance_model * draw_model * vec4(position, 1.0);\n"
+                                        "color = color_in * texelFetch(instances, texel + 4).rgb;\n"
+                                        "}\0";
+
 const GLchar *fragmentShaderSource = "#version 330 core\n"
                                      "in vec3 color;\n"
                                      "out vec4 color_out;\n"
@@ -54,133 +161,667 @@ float centerX = 0;
 float centerY = 0;
 float centerZ = 0;
 
+// In a window the values above come from the simulation thread, driven by held keys
+Simulation simulation;
+
+// Held keys and the simulation axis each one drives
+struct KeyControl
+{
+    int key;
+    SimAxis axis;
+    bool increase;
+};
+const KeyControl KEY_CONTROLS[] = {
+    {GLFW_KEY_RIGHT, AXIS_ROTATION_Y, true},
+    {GLFW_KEY_LEFT, AXIS_ROTATION_Y, false},
+    {GLFW_KEY_UP, AXIS_ROTATION_X, true},
+    {GLFW_KEY_DOWN, AXIS_ROTATION_X, false},
+    {GLFW_KEY_Z, AXIS_ROTATION_Z, true},
+    {GLFW_KEY_X, AXIS_ROTATION_Z, false},
+    {GLFW_KEY_W, AXIS_ZOOM, false},
+    {GLFW_KEY_S, AXIS_ZOOM, true},
+    {GLFW_KEY_C, AXIS_CAMERA_Y, false},
+    {GLFW_KEY_V, AXIS_CAMERA_Y, true},
+    {GLFW_KEY_I, AXIS_CENTER_X, true},
+    {GLFW_KEY_K, AXIS_CENTER_X, false},
+    {GLFW_KEY_L, AXIS_CENTER_Y, true},
+    {GLFW_KEY_J, AXIS_CENTER_Y, false},
+    {GLFW_KEY_N, AXIS_CENTER_Z, true},
+    {GLFW_KEY_M, AXIS_CENTER_Z, false},
+};
+
 bool shaderAttached = true;
-GLuint vertexShader, fragmentShader, shaderProgram, activeProgram;
+
+// On-demand rendering: the loop sleeps in glfwWaitEvents and redraws only when something is dirty
+bool onDemand = false;
+// Packed vertices: 12-byte quantized vertices instead of 24-byte floats (see PackedVertex)
+bool packedVertices = false;
+// Hot reload: vertex files are watched and re-uploaded when they change
+bool watchFiles = false;
+// Software rendering: headless frames are rasterized on the CPU instead of through GL
+bool softwareRenderer = false;
+// Multi-draw: meshes share meshArena and each frame's draws go out as one command buffer
+bool multiDraw = false;
+// Occlusion culling: instances hidden behind others are only drawn if their box shows
+bool occlusionCulling = false;
+bool viewDirty = true, modelDirty = true, redrawNeeded = true;
+int viewWidth = 0, viewHeight = 0;
+mat4x4 mvp, rot_obj;
+GLuint shaderProgram, activeProgram;
+GLint mvp_location, rotation_mat_location;
+GLint position_location, color_location, instance_model_location, instance_tint_location;
+
+// GPU buffers of one mesh file
+struct GpuMesh
+{
+    bool loaded = false;
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    ArenaRange arena; // with --multi-draw the mesh lives here instead of in its own buffers
+    GLintptr instance_offset = 0; // where the VAO's instance attributes currently point
+    Aabb bounds;
+    MeshLod lods[MESH_MAX_LODS];
+    int lod_count = 0;
+    mat4x4 dequantize; // maps packed [0, 1] positions onto the bounds; identity for floats
+    size_t vertex_capacity = 0, index_capacity = 0;
+    // Last uploaded contents, kept with --watch so a reload only sends the bytes that changed
+    std::vector<unsigned char> vertex_shadow, index_shadow;
+};
+
+// A placed model of the scene. Several models may share one mesh, which is
+// skipped while its file is still loading. Model i is node i of sceneGraph.
+struct SceneModel
+{
+    size_t mesh;
+    mat4x4 placement;
+    bool attached; // placed relative to a parent model rather than spun by rot_obj
+};
+
+std::vector<GpuMesh> gpuMeshes;
+// The software renderer reads vertices straight from the loaded meshes, by slot
+std::vector<Mesh> cpuMeshes;
+std::vector<SoftDraw> softwareDraws;
+std::vector<SceneModel> sceneModels;
+SceneGraph sceneGraph;
+GLsizei instance_count = 1;
+// Instances surviving the cull are streamed each time the view or the instances change
+StreamBuffer instanceStream;
+GLintptr instanceOffset = 0;
+
+// Every instance's box (the whole scene under its model matrix) lives in instanceBvh.
+// boundsDirty forces a refit, cullDirty a new cull and upload of visibleInstances.
+Bvh instanceBvh;
+Aabb sceneBounds;
+bool boundsDirty = true, cullDirty = true;
+std::vector<uint32_t> visibleInstances;
+CullStats cullStats;
+
+// Level of detail per instance from its projected size: below LOD_SCREEN_SIZES[k] pixels
+// level k + 1 is used. Switching needs a LOD_HYSTERESIS margin past the threshold, so
+// instances sitting near one don't flicker between levels.
+const float LOD_SCREEN_SIZES[MESH_MAX_LODS - 1] = {320.0f, 160.0f, 64.0f};
+const float LOD_HYSTERESIS = 0.15f;
+std::vector<unsigned char> instanceLod;
+
+// Visible instances are uploaded grouped by level; lodGroups holds each group's range
+struct LodGroup
+{
+    GLsizei first, count;
+};
+LodGroup lodGroups[MESH_MAX_LODS];
+double submittedTriangles = 0;
+// Draw calls issued by the last frame and the CPU time spent building and submitting them
+long drawCalls = 0;
+double submitMs = 0;
+// Each frame's draws go through renderQueue, sorted by key; renderState only passes on the
+// binds that change something and keeps its bindings from one frame to the next
+RenderQueue renderQueue;
+RenderState renderState;
+
+// With occlusion culling the frustum cull fills candidateInstances. Every frame those the
+// previous frame's queries found hidden are moved to deferredInstances, the rest stay in
+// visibleInstances; deferred ones are uploaded after the level groups, one slot each.
+OcclusionCuller occlusion;
+std::vector<uint32_t> candidateInstances, deferredInstances, splitDeferred;
+size_t vertexBufferBytes = 0;
+Fleet fleet;
+float animationTime = 0;
+FrameProfiler profiler;
+
+// Multi-draw state. Every loaded model gets one command per level of detail in use; the
+// command's base_instance selects its DrawRecord (read through attributes whose divisor
+// exceeds any draw's instance count, so they stay constant over the draw), and the
+// record's first_texel locates the draw's instances in instanceTexture.
+struct DrawRecord
+{
+    mat4x4 model; // world matrix times dequantize
+    GLint first_texel;
+    GLint padding[3];
+};
+const GLintptr INSTANCE_TEXELS = sizeof(Instance) / sizeof(vec4);
+static_assert(sizeof(Instance) == 5 * sizeof(vec4), "arenaVertexShaderSource fetches 5 texels per instance");
+bool multiDrawIndirect = false; // otherwise one glDrawElementsInstancedBaseVertex per command
+MeshArena meshArena;
+GLuint arenaVAO = 0, instanceTexture = 0;
+GLint instances_location, draw_model_location, draw_first_location;
+std::vector<DrawElementsIndirectCommand> drawCommands;
+std::vector<DrawRecord> drawRecords;
+StreamBuffer commandStream, drawStream;
 
 int main(int argc, char *argv[])
 {
+    auto program_start = std::chrono::steady_clock::now();
+    std::vector<std::string> inputs;
+    bool headless_mode = false;
+    int headless_frames = 300;
+    std::string trace_filename;
+    std::string screenshot_filename;
+    unsigned software_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    bool scaling = false;
+    std::string turntable_script;
+    std::string output_pattern = "turntable_%04d.ppm";
 
-    if (argc < 3)
+    // Flags with a value must be followed by one; counts have to be positive integers
+    auto flag_value = [&](int &i) -> std::string
     {
-        std::cout << "Usage: ./main <vertex_file> <num_of_vertex>" << std::endl;
+        if (i + 1 >= argc)
+        {
+            std::cout << argv[i] << " expects a value" << std::endl;
+            exit(-1);
+        }
+        return argv[++i];
+    };
+    auto flag_count = [&](int &i) -> int
+    {
+        std::string flag = argv[i];
+        std::string value = flag_value(i);
+        int count = 0;
+        std::from_chars_result parsed = std::from_chars(value.data(), value.data() + value.size(), count);
+        if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() || count <= 0)
+        {
+            std::cout << flag << " expects a positive number, got \"" << value << "\"" << std::endl;
+            exit(-1);
+        }
+        return count;
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--headless")
+            headless_mode = true;
+        else if (arg == "--frames")
+            headless_frames = flag_count(i);
+        else if (arg == "--trace")
+            trace_filename = flag_value(i);
+        else if (arg == "--fleet")
+            instance_count = flag_count(i);
+        else if (arg == "--on-demand")
+            onDemand = true;
+        else if (arg == "--packed")
+            packedVertices = true;
+        else if (arg == "--watch")
+            watchFiles = true;
+        else if (arg == "--software")
+            headless_mode = softwareRenderer = true;
+        else if (arg == "--threads")
+            software_threads = flag_count(i);
+        else if (arg == "--scaling")
+            scaling = true;
+        else if (arg == "--screenshot")
+            screenshot_filename = flag_value(i);
+        else if (arg == "--turntable")
+        {
+            turntable_script = flag_value(i);
+            headless_mode = true;
+        }
+        else if (arg == "--output")
+            output_pattern = flag_value(i);
+        else if (arg == "--multi-draw")
+            multiDraw = true;
+        else if (arg == "--occlusion")
+            occlusionCulling = true;
+        else
+            inputs.push_back(arg);
+    }
+
+    // Hidden instances are drawn one by one, which the single multi-draw can't express
+    if (occlusionCulling && multiDraw)
+    {
+        std::cout << "--occlusion does not combine with --multi-draw" << std::endl;
         exit(-1);
     }
+    occlusionCulling = occlusionCulling && !softwareRenderer;
 
-    printHelp();
-    char *vertex_filename = argv[1];
-    int vertex_count = atoi(argv[2]);
+    if (inputs.empty() || headless_frames <= 0 || instance_count <= 0)
+    {
+        std::cout << "Usage: ./main [--headless | --software [--threads N] [--scaling]] [--frames N] [--screenshot <file.ppm|file.png>] "
+                     "[--turntable <script> [--output <frame_%04d.ppm|frame_%04d.png>]] [--fleet N] [--on-demand] [--packed] [--multi-draw | --occlusion] [--watch] [--trace <file.json|file.csv>] <vertex_file>... | <scene.scene>"
+                  << std::endl;
+        exit(-1);
+    }
 
-    GLFWwindow *window = init();
+    // Scripts are checked up front, before any mesh is loaded
+    std::vector<TurntablePose> turntable_poses;
+    if (!turntable_script.empty())
+    {
+        std::string first_filename;
+        if (!turntable_filename(output_pattern, 0, first_filename))
+        {
+            std::cout << "--output needs a single %d field for the frame number, e.g. frames/%04d.png" << std::endl;
+            exit(-1);
+        }
+        if (!read_turntable_script(turntable_script, turntable_poses))
+            exit(-1);
+    }
 
-    vertexShader = compile_shader(vertexShaderSource, GL_VERTEX_SHADER);
-    fragmentShader = compile_shader(fragmentShaderSource, GL_FRAGMENT_SHADER);
+    if (!headless_mode)
+        printHelp();
 
-    // Link shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    // A single .scene argument is a manifest, anything else is a list of vertex files
+    std::vector<SceneEntry> scene;
+    const std::string scene_extension = ".scene";
+    if (inputs.size() == 1 && inputs[0].size() > scene_extension.size() &&
+        inputs[0].compare(inputs[0].size() - scene_extension.size(), scene_extension.size(), scene_extension) == 0)
+    {
+        if (!read_scene_manifest(inputs[0], scene))
+            exit(-1);
+    }
+    else
+    {
+        scene = layout_scene(inputs);
+    }
 
-    activeProgram = shaderProgram;
+    // Each distinct file is loaded once, however many models use it
+    std::vector<std::string> mesh_files;
+    for (const SceneEntry &entry : scene)
+    {
+        size_t slot = 0;
+        while (slot < mesh_files.size() && mesh_files[slot] != entry.filename)
+            slot++;
+        if (slot == mesh_files.size())
+            mesh_files.push_back(entry.filename);
 
-    // Set up vertex data (and buffer(s)) and attribute pointers
-    GLfloat vertices[1024];
-    read_vertices(vertices, vertex_filename);
+        SceneModel model;
+        model.mesh = slot;
+        mat4x4_translate(model.placement, entry.position[0], entry.position[1], entry.position[2]);
+        mat4x4_scale_aniso(model.placement, model.placement, entry.scale, entry.scale, entry.scale);
+        model.attached = entry.parent >= 0;
+        sceneModels.push_back(model);
 
-    GLuint color_location, position_location, mvp_location, rotation_mat_location;
-    mvp_location = glGetUniformLocation(shaderProgram, "mvp");
-    position_location = glGetAttribLocation(shaderProgram, "position");
-    color_location = glGetAttribLocation(shaderProgram, "color_in");
-    rotation_mat_location = glGetUniformLocation(shaderProgram, "rotation_mat");
+        // Attached parts keep a fixed local transform; free-standing models get theirs each
+        // time the rotation changes (build_model_rotation)
+        int node = sceneGraph.add_node(entry.parent);
+        if (model.attached)
+            sceneGraph.set_local(node, model.placement);
+    }
 
-    GLuint VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
+    if (mesh_files.empty())
+    {
+        std::cout << "Scene has no models" << std::endl;
+        exit(-1);
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    // Meshes parse on worker threads while the window, GLEW and shaders come up here
+    AssetLoader loader;
+    loader.start(mesh_files, std::thread::hardware_concurrency());
+    gpuMeshes.resize(mesh_files.size());
 
-    glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid *)0);
-    glEnableVertexAttribArray(position_location);
+    cpuMeshes.resize(mesh_files.size());
 
-    glVertexAttribPointer(color_location, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid *)(sizeof(GLfloat) * 3));
-    glEnableVertexAttribArray(color_location);
+    // The software renderer needs no GL context at all
+    GLFWwindow *window = nullptr;
+    HeadlessContext headless;
+    if (softwareRenderer)
+    {
+        std::cout << "Software renderer: " << software_threads << " threads, "
+                  << SOFT_TILE_SIZE << "x" << SOFT_TILE_SIZE << " tiles" << std::endl;
+    }
+    else if (headless_mode)
+    {
+        if (!init_headless(headless, WIDTH, HEIGHT))
+            exit(-1);
+    }
+    else
+    {
+        window = init();
+    }
 
-    mat4x4 mvp;
-    mat4x4_identity(mvp);
+    if (!softwareRenderer)
+    {
+        // Program binaries are cached next to the executable
+        std::string executable = argv[0];
+        size_t slash = executable.find_last_of('/');
+        std::string cache_dir = slash == std::string::npos ? "." : executable.substr(0, slash);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+        shaderProgram = load_program(multiDraw ? arenaVertexShaderSource : vertexShaderSource, fragmentShaderSource, cache_dir);
+        if (!shaderProgram)
+            exit(-1);
+
+        activeProgram = shaderProgram;
+
+        // Attribute and uniform locations shared by every mesh
+        mvp_location = glGetUniformLocation(shaderProgram, "mvp");
+        position_location = glGetAttribLocation(shaderProgram, "position");
+        color_location = glGetAttribLocation(shaderProgram, "color_in");
+        instance_model_location = glGetAttribLocation(shaderProgram, "instance_model");
+        instance_tint_location = glGetAttribLocation(shaderProgram, "instance_tint");
+        rotation_mat_location = glGetUniformLocation(shaderProgram, "rotation_mat");
+        instances_location = glGetUniformLocation(shaderProgram, "instances");
+        draw_model_location = glGetAttribLocation(shaderProgram, "draw_model");
+        draw_first_location = glGetAttribLocation(shaderProgram, "draw_first");
 
-    glEnable(GL_DEPTH_TEST);
+        // One query per instance of the fleet
+        if (occlusionCulling && !occlusion.init(instance_count, cache_dir))
+            exit(-1);
+    }
+
+    // Per-instance model matrices and tints, shared by every mesh's VAO
+    build_formation(fleet, instance_count);
+    if (!softwareRenderer)
+    {
+        instanceStream.init(GL_ARRAY_BUFFER, fleet.instances.size() * sizeof(Instance));
+        glEnable(GL_DEPTH_TEST);
+        if (multiDraw)
+            init_arena();
+    }
+
+    // Reloads wake up a window sleeping in glfwWaitEvents
+    MeshWatcher watcher;
+    if (watchFiles)
+    {
+        std::function<void()> notify;
+        if (!headless_mode)
+            notify = [] { glfwPostEmptyEvent(); };
+        watcher.start(mesh_files, notify);
+    }
+
+    double init_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - program_start).count();
+    size_t meshes_ready = 0, meshes_uploaded = 0;
+    bool first_frame = true;
+
+    // Headless benchmarks need the whole scene; the window starts drawing right away and
+    // picks meshes up as they finish (below)
+    if (headless_mode)
+    {
+        LoadedMesh loaded;
+        while (loader.wait(loaded))
+        {
+            if (loaded.mesh.vertex_count > 0)
+            {
+                if (softwareRenderer)
+                    keep_mesh(loaded.index, loaded.mesh);
+                else
+                    upload_mesh(loaded.index, loaded.mesh);
+                meshes_uploaded++;
+            }
+            meshes_ready++;
+        }
+
+        if (meshes_uploaded == 0)
+        {
+            std::cout << "No vertices loaded from the scene" << std::endl;
+            exit(-1);
+        }
+    }
+
+    // GPU timer queries need GL, so frames are only profiled on the GL path
+    profiler.enabled = !trace_filename.empty() && !softwareRenderer;
+    profiler.init();
+
+    bool turntable_failed = false;
+    if (!turntable_poses.empty())
+    {
+        turntable_failed = !render_turntable(turntable_poses, output_pattern, headless, software_threads);
+    }
+    else if (headless_mode)
+    {
+        // Fixed number of frames into the offscreen framebuffer. glFinish stands in for the
+        // blocking buffer swap so each sample covers the GPU work of its frame.
+        // The first frames (shader JIT, buffer residency) are not timed.
+        // --scaling repeats the software run with 1, 2, ... threads.
+        SoftRasterizer rasterizer;
+        double single_thread_ms = 0;
+        unsigned threads = softwareRenderer && scaling ? 1 : software_threads;
+        for (; threads <= software_threads; threads++)
+        {
+            double pass_ms[3] = {0, 0, 0};
+            double submit_ms = 0;
+            if (softwareRenderer)
+                rasterizer.init(WIDTH, HEIGHT, threads);
+
+            std::vector<double> frame_ms;
+            frame_ms.reserve(headless_frames);
+            for (int frame = -HEADLESS_WARMUP_FRAMES; frame < headless_frames; frame++)
+            {
+                auto frame_start = std::chrono::steady_clock::now();
+                profiler.begin_frame();
+                rotationY += 0.05;
+                animationTime += 1.0f / 60.0f;
+                modelDirty = true;
+                if (watchFiles)
+                    apply_reloads(watcher, mesh_files);
+
+                if (softwareRenderer)
+                {
+                    draw_frame_software(rasterizer);
+                }
+                else
+                {
+                    draw_frame(headless.width, headless.height);
+                    profiler.begin_stage(STAGE_SWAP_BUFFERS);
+                    glFinish();
+                    profiler.end_stage(STAGE_SWAP_BUFFERS);
+                }
+                profiler.end_frame();
+                if (first_frame)
+                {
+                    report_first_frame(program_start, init_ms);
+                    first_frame = false;
+                }
+                if (frame >= 0)
+                {
+                    frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count());
+                    pass_ms[0] += rasterizer.transform_ms;
+                    pass_ms[1] += rasterizer.bin_ms;
+                    pass_ms[2] += rasterizer.raster_ms;
+                    submit_ms += submitMs;
+                }
+            }
+
+            if (softwareRenderer)
+            {
+                std::cout << threads << " threads: transform " << pass_ms[0] / headless_frames << " ms, bin "
+                          << pass_ms[1] / headless_frames << " ms, raster " << pass_ms[2] / headless_frames
+                          << " ms per frame, " << rasterizer.steals() << " steals" << std::endl;
+            }
+            print_frame_stats(frame_ms, submittedTriangles);
+            if (!softwareRenderer)
+            {
+                std::cout << "Submission: " << drawCalls << " draw calls, " << submit_ms / headless_frames
+                          << " ms CPU per frame" << std::endl;
+            }
+
+            std::sort(frame_ms.begin(), frame_ms.end());
+            double median_ms = frame_ms[(frame_ms.size() - 1) / 2];
+            if (threads == 1)
+                single_thread_ms = median_ms;
+            if (softwareRenderer && scaling && single_thread_ms > 0)
+                std::cout << "  speedup over 1 thread: " << single_thread_ms / median_ms << "x" << std::endl;
+        }
 
-    // Game loop
-    while (!glfwWindowShouldClose(window))
+        // Last frame, bottom row first as it comes out of glReadPixels
+        if (!screenshot_filename.empty())
+        {
+            bool written;
+            if (softwareRenderer)
+            {
+                written = write_image(screenshot_filename, rasterizer.color.data(), rasterizer.width, rasterizer.height, rasterizer.stride);
+            }
+            else
+            {
+                std::vector<uint32_t> pixels((size_t)headless.width * headless.height);
+                glReadPixels(0, 0, headless.width, headless.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+                written = write_image(screenshot_filename, pixels.data(), headless.width, headless.height, headless.width);
+            }
+            if (written)
+                std::cout << "Wrote " << screenshot_filename << std::endl;
+        }
+    }
+    else
     {
-        mat4x4 m, v, p, rot_obj, mEye;
-        // Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
-        glfwPollEvents();
+        size_t shown_visible = fleet.instances.size() + 1;
+        simulation.start([] { glfwPostEmptyEvent(); });
 
-        // Clear color and depth buffer
-        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-        glClearColor(0.52, 0.8, 0.92, 1.f);
+        // Game loop
+        while (!glfwWindowShouldClose(window))
+        {
+            int width, height;
 
-        mat4x4_identity(mvp);
-        mat4x4_identity(m);
-        mat4x4_identity(v);
-        mat4x4_identity(p);
-        mat4x4_identity(rot_obj);
-        mat4x4_identity(mEye);
+            // Sleep until input arrives or the simulation moves something; animated fleets and
+            // models still gliding to a stop wake up once per frame
+            if (onDemand)
+            {
+                if (fleet.animated || simulation.moving())
+                    glfwWaitEventsTimeout(1.0 / 60.0);
+                else
+                    glfwWaitEvents();
+            }
 
-        int width, height;
-        glfwGetFramebufferSize(window, &width, &height);
-        glViewport(0, 0, width, height);
-        float ratio = width / (float)height;
+            apply_simulation();
+            if (watchFiles)
+                apply_reloads(watcher, mesh_files);
 
-        mat4x4_ortho(p, -ratio - zoom, ratio + zoom, -1.f - zoom, 1.f + zoom, 100.f, -100.f);
+            if (onDemand)
+            {
+                glfwGetFramebufferSize(window, &width, &height);
+                bool resized = width != viewWidth || height != viewHeight;
+                if (!redrawNeeded && !viewDirty && !modelDirty && !resized && !fleet.animated)
+                    continue;
+            }
 
-        vec3 eye = {0.f, 0.f, 1.f};
-        vec3 center = {0.f, 0.f, 0.f};
-        vec3 up = {0.f, 1.f, 0.f};
-        mat4x4_look_at(v, eye, center, up);
+            // Upload whatever the loader finished since the last frame
+            if (meshes_ready < mesh_files.size())
+            {
+                std::vector<LoadedMesh> ready;
+                loader.poll(ready);
+                for (LoadedMesh &loaded : ready)
+                {
+                    // A slot already loaded was reloaded by the watcher before its first
+                    // parse came in; that parse is older and must not replace the reload
+                    if (gpuMeshes[loaded.index].loaded)
+                    {
+                        meshes_uploaded++;
+                    }
+                    else if (loaded.mesh.vertex_count > 0)
+                    {
+                        upload_mesh(loaded.index, loaded.mesh);
+                        meshes_uploaded++;
+                    }
+                    meshes_ready++;
+                    redrawNeeded = true;
+                }
 
-        mat4x4_rotate_Y(m, m, rotationCameraY);
+                if (meshes_ready == mesh_files.size() && meshes_uploaded == 0)
+                {
+                    std::cout << "No vertices loaded from the scene" << std::endl;
+                    break;
+                }
+                if (meshes_ready == mesh_files.size())
+                {
+                    std::cout << "Scene complete after "
+                              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - program_start).count()
+                              << " ms" << std::endl;
+                }
+            }
 
-        // For rotating camera with center at eye
-        mat4x4_translate(mEye, -eye[0], -eye[1], -eye[2]);
-        mat4x4_mul(m, m, mEye);
-        mat4x4_rotate_X(m, m, centerX);
-        mat4x4_rotate_Y(m, m, centerY);
-        mat4x4_rotate_Z(m, m, centerZ);
-        mat4x4_translate(mEye, eye[0], eye[1], eye[2]);
-        mat4x4_mul(m, m, mEye);
+            profiler.begin_frame();
 
-        mat4x4_rotate_X(rot_obj, rot_obj, rotationX);
-        mat4x4_rotate_Y(rot_obj, rot_obj, rotationY);
-        mat4x4_rotate_Z(rot_obj, rot_obj, rotationZ);
+            // Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
+            {
+                ProfileScope scope(profiler, STAGE_POLL_EVENTS);
+                glfwPollEvents();
+            }
+
+            glfwGetFramebufferSize(window, &width, &height);
+            draw_frame(width, height);
+            redrawNeeded = false;
+
+            // Culling counts of larger fleets go in the title bar
+            if (fleet.instances.size() > 1 && visibleInstances.size() != shown_visible)
+            {
+                shown_visible = visibleInstances.size();
+                std::string title = "Project 1 - " + std::to_string(shown_visible) + " drawn, " +
+                                    std::to_string(fleet.instances.size() - shown_visible) + " culled";
+                glfwSetWindowTitle(window, title.c_str());
+            }
+
+            // Swap the screen buffers
+            {
+                ProfileScope scope(profiler, STAGE_SWAP_BUFFERS);
+                glfwSwapBuffers(window);
+            }
 
-        mat4x4_mul(v, v, m);
-        mat4x4_mul(mvp, p, v);
+            if (first_frame)
+            {
+                report_first_frame(program_start, init_ms);
+                first_frame = false;
+            }
 
-        glUseProgram(activeProgram);
-        glBindVertexArray(VAO);
+            profiler.end_frame();
+        }
+    }
 
-        glUniformMatrix4fv(rotation_mat_location, 1, GL_FALSE, (GLfloat *)rot_obj);
-        glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (GLfloat *)mvp);
-        glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+    if (profiler.enabled)
+    {
+        profiler.print_summary();
+        profiler.write(trace_filename);
+        profiler.destroy();
+    }
+    watcher.stop();
+    simulation.stop();
+    simulation.print_stats();
+    cullStats.print();
+    if (softwareRenderer)
+        return turntable_failed ? -1 : 0;
 
-        glBindVertexArray(0);
+    instanceStream.print_stats();
+    renderState.print_stats();
+    if (occlusionCulling)
+    {
+        occlusion.print_stats();
+        occlusion.destroy();
+    }
+    std::cout << "Vertex buffers: " << vertexBufferBytes / 1024.0 << " KB ("
+              << (packedVertices ? "packed" : "float") << " layout)" << std::endl;
+    glDeleteProgram(shaderProgram);
 
-        // Swap the screen buffers
-        glfwSwapBuffers(window);
+    if (multiDraw)
+    {
+        meshArena.print_stats();
+        meshArena.destroy();
+        glDeleteVertexArrays(1, &arenaVAO);
+        glDeleteTextures(1, &instanceTexture);
+        if (multiDrawIndirect)
+        {
+            commandStream.destroy();
+            drawStream.destroy();
+        }
     }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
 
     // Properly de-allocate all resources once they've outlived their purpose
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    for (GpuMesh &gpu : gpuMeshes)
+    {
+        glDeleteVertexArrays(1, &gpu.VAO);
+        glDeleteBuffers(1, &gpu.VBO);
+        glDeleteBuffers(1, &gpu.EBO);
+    }
+    instanceStream.destroy();
+
+    if (headless_mode)
+    {
+        destroy_headless(headless);
+        return turntable_failed ? -1 : 0;
+    }
 
     // Terminate GLFW, clearing any resources allocated by GLFW.
     glfwDestroyWindow(window);
@@ -188,43 +829,945 @@ int main(int argc, char *argv[])
     return 0;
 }
 
+// Brings matrices, instance transforms and the visible set up to date for a width x height frame
+void update_scene(int width, int height)
+{
+    // Matrices are only rebuilt when the state they depend on has changed
+    profiler.begin_stage(STAGE_BUILD_MATRICES);
+    if (width != viewWidth || height != viewHeight)
+    {
+        viewWidth = width;
+        viewHeight = height;
+        viewDirty = true;
+    }
+    if (viewDirty)
+    {
+        build_view_projection(width / (float)height);
+        cullDirty = true;
+    }
+    if (modelDirty)
+        build_model_rotation();
+    if (sceneGraph.update() > 0)
+        boundsDirty = true;
+
+    // Formations move on their own, one batched pass recomposes every instance matrix
+    if (fleet.animated)
+    {
+        update_fleet(fleet, animationTime);
+        boundsDirty = true;
+    }
+    profiler.end_stage(STAGE_BUILD_MATRICES);
+
+    profiler.begin_stage(STAGE_CULL);
+    if (boundsDirty || cullDirty)
+        cull_instances();
+    profiler.end_stage(STAGE_CULL);
+}
+
+// Renders the model with the current rotation/camera state into the bound framebuffer
+void draw_frame(int width, int height)
+{
+    profiler.begin_gpu();
+
+    // Clear color and depth buffer; the clear only reaches the depth buffer with writes on
+    renderState.begin_frame();
+    renderState.set_transparent(false);
+    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    glClearColor(CLEAR_COLOR[0], CLEAR_COLOR[1], CLEAR_COLOR[2], CLEAR_COLOR[3]);
+
+    glViewport(0, 0, width, height);
+    update_scene(width, height);
+
+    renderState.use_program(activeProgram);
+
+    profiler.begin_stage(STAGE_UPLOAD_UNIFORMS);
+    glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (GLfloat *)mvp);
+
+    // Query results can move instances between the drawn and the deferred set
+    if (occlusionCulling)
+        split_occluded();
+
+    if (cullDirty)
+    {
+        // Visible instances only, grouped by level of detail and packed into the ring region
+        // the GPU is done with; the draws below read them at instanceOffset
+        select_lods();
+        Instance *instances = (Instance *)instanceStream.begin_write(instanceOffset);
+        if (instances)
+        {
+            GLsizei next[MESH_MAX_LODS];
+            for (int level = 0; level < MESH_MAX_LODS; level++)
+                next[level] = lodGroups[level].first;
+            for (uint32_t index : visibleInstances)
+                instances[next[instanceLod[index]]++] = fleet.instances[index];
+            GLsizei slot = (GLsizei)visibleInstances.size();
+            for (uint32_t index : deferredInstances)
+                instances[slot++] = fleet.instances[index];
+        }
+        instanceStream.end_write();
+        cullDirty = false;
+    }
+    profiler.end_stage(STAGE_UPLOAD_UNIFORMS);
+
+    profiler.begin_stage(STAGE_DRAW);
+    auto submit_start = std::chrono::steady_clock::now();
+    submittedTriangles = 0;
+    drawCalls = 0;
+    if (multiDraw)
+    {
+        draw_arena();
+    }
+    else
+    {
+        draw_queue();
+        if (occlusionCulling)
+            draw_occluded();
+    }
+    submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submit_start).count();
+    profiler.end_stage(STAGE_DRAW);
+
+    // The region may be rewritten once these draws have executed
+    instanceStream.fence();
+
+    profiler.end_gpu();
+}
+
+// Per-mesh draw path: one queue item per loaded model and level in use. Sorting groups the
+// items of a mesh (and within it, of a level) together, front to back, so its VAO is bound
+// and its instance attributes pointed only once however many models place it.
+void draw_queue()
+{
+    renderQueue.clear();
+    for (size_t i = 0; i < sceneModels.size() && !visibleInstances.empty(); i++)
+    {
+        size_t mesh = sceneModels[i].mesh;
+        const GpuMesh &gpu = gpuMeshes[mesh];
+        if (!gpu.loaded)
+            continue;
+
+        float depth = model_depth(i);
+        for (int level = 0; level < MESH_MAX_LODS; level++)
+        {
+            const LodGroup &group = lodGroups[level];
+            if (group.count == 0)
+                continue;
+
+            // Meshes with fewer levels draw their coarsest one
+            const MeshLod &lod = gpu.lods[std::min(level, gpu.lod_count - 1)];
+            RenderItem item;
+            item.program = activeProgram;
+            item.vertex_array = gpu.VAO;
+            item.transparent = false;
+            item.model = (uint32_t)i;
+            item.mesh = (uint32_t)mesh;
+            item.instance_offset = instanceOffset + group.first * sizeof(Instance);
+            item.index_count = lod.index_count;
+            item.first_index = lod.index_offset;
+            item.instance_count = group.count;
+
+            // A single program; meshes are told apart by slot and their draws by level
+            renderQueue.push(render_key(false, 0, (uint32_t)mesh, (uint32_t)level, depth), item);
+        }
+    }
+    renderQueue.sort();
+
+    for (size_t k = 0; k < renderQueue.size(); k++)
+    {
+        const RenderItem &item = renderQueue.sorted(k);
+        GpuMesh &gpu = gpuMeshes[item.mesh];
+        renderState.set_transparent(item.transparent);
+        renderState.use_program(item.program);
+        renderState.bind_vertex_array(item.vertex_array);
+        if (gpu.instance_offset != item.instance_offset)
+        {
+            bind_instance_attributes(item.instance_offset);
+            gpu.instance_offset = item.instance_offset;
+        }
+        if (renderState.change_model(item.model))
+        {
+            mat4x4 model_matrix;
+            mat4x4_mul(model_matrix, sceneGraph.world[item.model].matrix, gpu.dequantize);
+            glUniformMatrix4fv(rotation_mat_location, 1, GL_FALSE, (GLfloat *)model_matrix);
+        }
+
+        glDrawElementsInstanced(GL_TRIANGLES, item.index_count, GL_UNSIGNED_INT, (GLvoid *)(item.first_index * sizeof(GLuint)), item.instance_count);
+        drawCalls++;
+        submittedTriangles += item.index_count / 3.0 * item.instance_count;
+    }
+    renderState.end_frame(renderQueue.size());
+}
+
+// Depth of a model's bounds center after mvp, mapped to [0, 1] (0 nearest), for sorting
+float model_depth(size_t model)
+{
+    const Aabb &bounds = gpuMeshes[sceneModels[model].mesh].bounds;
+    vec4 center = {(bounds.min[0] + bounds.max[0]) * 0.5f, (bounds.min[1] + bounds.max[1]) * 0.5f,
+                   (bounds.min[2] + bounds.max[2]) * 0.5f, 1.0f};
+    mat4x4 model_mvp;
+    vec4 clip;
+    mat4x4_mul(model_mvp, mvp, sceneGraph.world[model].matrix);
+    mat4x4_mul_vec4(clip, model_mvp, center);
+    return clip[3] != 0.0f ? (clip[2] / clip[3]) * 0.5f + 0.5f : 0.5f;
+}
+
+// Splits the frustum's candidates by the previous frame's occlusion results. Levels and the
+// instance upload are only redone when an instance changed sides (or the candidates changed).
+void split_occluded()
+{
+    occlusion.collect();
+    splitDeferred.clear();
+    for (uint32_t index : candidateInstances)
+    {
+        if (occlusion.is_hidden(index))
+            splitDeferred.push_back(index);
+    }
+    if (!cullDirty && splitDeferred == deferredInstances)
+        return;
+
+    deferredInstances.swap(splitDeferred);
+    visibleInstances.clear();
+    for (uint32_t index : candidateInstances)
+    {
+        if (!occlusion.is_hidden(index))
+            visibleInstances.push_back(index);
+    }
+    cullDirty = true;
+}
+
+// After the visible instances are drawn: tests the box of every candidate against their
+// depth, then draws each deferred instance on condition that its box showed. Deferred
+// instances are not counted in submittedTriangles, as the CPU never learns which were drawn.
+void draw_occluded()
+{
+    occlusion.query(candidateInstances, instanceBvh.item_bounds, mvp);
+    renderState.invalidate();
+
+    GLintptr first = instanceOffset + visibleInstances.size() * sizeof(Instance);
+    for (size_t i = 0; i < sceneModels.size() && !deferredInstances.empty(); i++)
+    {
+        GpuMesh &gpu = gpuMeshes[sceneModels[i].mesh];
+        if (!gpu.loaded)
+            continue;
+
+        renderState.use_program(activeProgram);
+        renderState.bind_vertex_array(gpu.VAO);
+        if (renderState.change_model((uint32_t)i))
+        {
+            mat4x4 model_matrix;
+            mat4x4_mul(model_matrix, sceneGraph.world[i].matrix, gpu.dequantize);
+            glUniformMatrix4fv(rotation_mat_location, 1, GL_FALSE, (GLfloat *)model_matrix);
+        }
+
+        // Without base instances (GL 3.3) each draw points the attributes at its slot
+        for (size_t d = 0; d < deferredInstances.size(); d++)
+        {
+            GLintptr offset = first + d * sizeof(Instance);
+            if (gpu.instance_offset != offset)
+            {
+                bind_instance_attributes(offset);
+                gpu.instance_offset = offset;
+            }
+
+            uint32_t index = deferredInstances[d];
+            const MeshLod &lod = gpu.lods[std::min((int)instanceLod[index], gpu.lod_count - 1)];
+            occlusion.begin_conditional(index);
+            glDrawElementsInstanced(GL_TRIANGLES, lod.index_count, GL_UNSIGNED_INT, (GLvoid *)(lod.index_offset * sizeof(GLuint)), 1);
+            occlusion.end_conditional();
+            drawCalls++;
+        }
+    }
+}
+
+// Same frame as draw_frame, rasterized on the CPU: one SoftDraw per visible instance of
+// each model, in the order the instanced GL draws would submit them
+void draw_frame_software(SoftRasterizer &rasterizer)
+{
+    update_scene(rasterizer.width, rasterizer.height);
+    if (cullDirty)
+    {
+        select_lods();
+        cullDirty = false;
+    }
+
+    // Visible instances grouped by level, as they are laid out in the instance ring
+    std::vector<uint32_t> grouped(visibleInstances.size());
+    GLsizei next[MESH_MAX_LODS];
+    for (int level = 0; level < MESH_MAX_LODS; level++)
+        next[level] = lodGroups[level].first;
+    for (uint32_t index : visibleInstances)
+        grouped[next[instanceLod[index]]++] = index;
+
+    softwareDraws.clear();
+    submittedTriangles = 0;
+    for (size_t i = 0; i < sceneModels.size(); i++)
+    {
+        const GpuMesh &gpu = gpuMeshes[sceneModels[i].mesh];
+        if (!gpu.loaded)
+            continue;
+
+        for (int level = 0; level < MESH_MAX_LODS; level++)
+        {
+            const LodGroup &group = lodGroups[level];
+            const MeshLod &lod = gpu.lods[std::min(level, gpu.lod_count - 1)];
+            for (GLsizei g = group.first; g < group.first + group.count; g++)
+            {
+                const Instance &instance = fleet.instances[grouped[g]];
+                SoftDraw draw;
+                draw.mesh = &cpuMeshes[sceneModels[i].mesh];
+                draw.index_offset = lod.index_offset;
+                draw.index_count = lod.index_count;
+                mat4x4 instance_world;
+                mat4x4_mul(instance_world, *(mat4x4 *)instance.model, sceneGraph.world[i].matrix);
+                mat4x4_mul(draw.matrix, mvp, instance_world);
+                for (int channel = 0; channel < 3; channel++)
+                    draw.tint[channel] = instance.tint[channel];
+                softwareDraws.push_back(draw);
+            }
+            submittedTriangles += lod.index_count / 3.0 * group.count;
+        }
+    }
+
+    profiler.begin_stage(STAGE_DRAW);
+    rasterizer.render(softwareDraws, CLEAR_COLOR);
+    profiler.end_stage(STAGE_DRAW);
+}
+
+// Takes over the levels of detail and bounds of a loaded mesh; models using it start drawing
+void set_mesh_levels(GpuMesh &gpu, const Mesh &mesh)
+{
+    gpu.lod_count = mesh.lod_count;
+    memcpy(gpu.lods, mesh.lods, sizeof(gpu.lods));
+    if (gpu.lod_count == 0)
+    {
+        gpu.lods[0] = {0, mesh.index_count, 0.0f};
+        gpu.lod_count = 1;
+    }
+    memcpy(gpu.bounds.min, mesh.bounds_min, sizeof(gpu.bounds.min));
+    memcpy(gpu.bounds.max, mesh.bounds_max, sizeof(gpu.bounds.max));
+    gpu.loaded = true;
+    boundsDirty = true;
+}
+
+// Creates the buffers and VAO of a loaded mesh (or its range of the arena with --multi-draw);
+// models using its slot start drawing it. Called again for a mesh already on the GPU (a
+// reload), it refills the existing buffers. Returns the number of bytes sent to the GPU.
+size_t upload_mesh(size_t slot, const Mesh &mesh)
+{
+    GpuMesh &gpu = gpuMeshes[slot];
+    std::vector<PackedVertex> packed;
+    const void *vertex_data = mesh.data();
+    size_t vertex_size = mesh.byte_size();
+    if (packedVertices)
+    {
+        packed = pack_vertices(mesh);
+        vertex_data = packed.data();
+        vertex_size = packed.size() * sizeof(PackedVertex);
+
+        // Scale by the extent, then translate to the minimum corner
+        mat4x4_translate(gpu.dequantize, mesh.bounds_min[0], mesh.bounds_min[1], mesh.bounds_min[2]);
+        mat4x4_scale_aniso(gpu.dequantize, gpu.dequantize, mesh.bounds_max[0] - mesh.bounds_min[0],
+                           mesh.bounds_max[1] - mesh.bounds_min[1], mesh.bounds_max[2] - mesh.bounds_min[2]);
+    }
+    else
+    {
+        mat4x4_identity(gpu.dequantize);
+    }
+
+    // The arena keeps no shadow copies: a reload rewrites the whole mesh
+    if (multiDraw)
+    {
+        if (meshArena.allocate(gpu.arena, mesh.vertex_count, mesh.index_count))
+            bind_arena_buffers();
+        meshArena.write(gpu.arena, vertex_data, mesh.index_data());
+        vertexBufferBytes = (size_t)meshArena.vertex_capacity * meshArena.vertex_size;
+        set_mesh_levels(gpu, mesh);
+        return vertex_size + mesh.index_byte_size();
+    }
+
+    bool created = gpu.VAO == 0;
+    if (created)
+    {
+        glGenVertexArrays(1, &gpu.VAO);
+        glGenBuffers(1, &gpu.VBO);
+        glGenBuffers(1, &gpu.EBO);
+    }
+    glBindVertexArray(gpu.VAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gpu.VBO);
+    size_t previous_capacity = gpu.vertex_capacity;
+    size_t uploaded = update_buffer(GL_ARRAY_BUFFER, gpu.vertex_shadow, gpu.vertex_capacity, vertex_data, vertex_size);
+    vertexBufferBytes += gpu.vertex_capacity - previous_capacity;
+
+    // The element buffer binding is stored in the VAO
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.EBO);
+    uploaded += update_buffer(GL_ELEMENT_ARRAY_BUFFER, gpu.index_shadow, gpu.index_capacity, mesh.index_data(), mesh.index_byte_size());
+    set_mesh_levels(gpu, mesh);
+
+    if (created)
+    {
+        bind_vertex_attributes();
+        bind_instance_attributes(instanceOffset);
+        gpu.instance_offset = instanceOffset;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    renderState.invalidate();
+    return uploaded;
+}
+
+// Software renderer counterpart of upload_mesh: the mesh itself stays in cpuMeshes
+void keep_mesh(size_t slot, Mesh &mesh)
+{
+    cpuMeshes[slot] = std::move(mesh);
+    set_mesh_levels(gpuMeshes[slot], cpuMeshes[slot]);
+}
+
+// Brings the buffer bound to target up to date with data. The storage is reallocated only
+// when data no longer fits in it; otherwise, with a shadow copy of the last upload (--watch),
+// only the range between the first and the last differing byte is written.
+// Returns the number of bytes uploaded.
+size_t update_buffer(GLenum target, std::vector<unsigned char> &shadow, size_t &capacity, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    if (size > capacity)
+    {
+        glBufferData(target, size, data, GL_STATIC_DRAW);
+        capacity = size;
+        if (watchFiles)
+            shadow.assign(bytes, bytes + size);
+        return size;
+    }
+    if (!watchFiles)
+    {
+        glBufferSubData(target, 0, size, data);
+        return size;
+    }
+
+    size_t first = std::mismatch(bytes, bytes + std::min(size, shadow.size()), shadow.data()).first - bytes;
+    size_t end = size;
+    if (size == shadow.size())
+    {
+        while (end > first && bytes[end - 1] == shadow[end - 1])
+            end--;
+    }
+
+    if (end > first)
+        glBufferSubData(target, first, end - first, bytes + first);
+    shadow.assign(bytes, bytes + size);
+    return end - first;
+}
+
+// Uploads the vertex files the watcher parsed again and logs how long each reload took,
+// from noticing the change to the data being on the GPU
+void apply_reloads(MeshWatcher &watcher, const std::vector<std::string> &mesh_files)
+{
+    std::vector<ReloadedMesh> ready;
+    watcher.poll(ready);
+    for (ReloadedMesh &reloaded : ready)
+    {
+        const std::string &filename = mesh_files[reloaded.index];
+        if (reloaded.mesh.vertex_count == 0)
+        {
+            std::cout << "Reloading " << filename << " found no vertices, keeping the previous version" << std::endl;
+            continue;
+        }
+
+        auto upload_start = std::chrono::steady_clock::now();
+        size_t uploaded = 0;
+        if (softwareRenderer)
+            keep_mesh(reloaded.index, reloaded.mesh);
+        else
+            uploaded = upload_mesh(reloaded.index, reloaded.mesh);
+        auto upload_end = std::chrono::steady_clock::now();
+        const GpuMesh &gpu = gpuMeshes[reloaded.index];
+
+        std::cout << "Reloaded " << filename << " in "
+                  << std::chrono::duration<double, std::milli>(upload_end - reloaded.changed).count() << " ms (parse "
+                  << reloaded.parse_ms << " ms, upload "
+                  << std::chrono::duration<double, std::milli>(upload_end - upload_start).count() << " ms): "
+                  << uploaded << " of " << (multiDraw ? uploaded : gpu.vertex_shadow.size() + gpu.index_shadow.size())
+                  << " bytes re-uploaded" << std::endl;
+        redrawNeeded = true;
+    }
+}
+
+// Points the bound VAO's position and color at the bound vertex buffer, in the packed or
+// the float layout
+void bind_vertex_attributes()
+{
+    if (packedVertices)
+    {
+        glVertexAttribPointer(position_location, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex),
+                              (GLvoid *)offsetof(PackedVertex, position));
+        glVertexAttribPointer(color_location, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex),
+                              (GLvoid *)offsetof(PackedVertex, color));
+    }
+    else
+    {
+        glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (GLvoid *)0);
+        glVertexAttribPointer(color_location, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (GLvoid *)(sizeof(GLfloat) * 3));
+    }
+    glEnableVertexAttribArray(position_location);
+    glEnableVertexAttribArray(color_location);
+}
+
+// Points the bound VAO's per-instance model matrix (one column per attribute location) and
+// tint at the instance data starting at offset, advanced once per instance
+void bind_instance_attributes(GLintptr offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instanceStream.buffer);
+    for (int column = 0; column < 4; column++)
+    {
+        glVertexAttribPointer(instance_model_location + column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid *)(offset + offsetof(Instance, model) + sizeof(vec4) * column));
+        glEnableVertexAttribArray(instance_model_location + column);
+        glVertexAttribDivisor(instance_model_location + column, 1);
+    }
+
+    glVertexAttribPointer(instance_tint_location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid *)(offset + offsetof(Instance, tint)));
+    glEnableVertexAttribArray(instance_tint_location);
+    glVertexAttribDivisor(instance_tint_location, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Sets up the multi-draw path: the arena and its VAO, the buffer texture over the instance
+// stream and, when the commands can be submitted indirectly, the rings they are streamed in
+void init_arena()
+{
+    multiDrawIndirect = multi_draw_indirect_supported();
+
+    // The instance ring is read as RGBA32F texels; each region starts 64-byte aligned
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    size_t texels = instanceStream.region_size * STREAM_BUFFER_REGIONS / sizeof(vec4);
+    if (texels > (size_t)max_texels)
+    {
+        std::cout << "--multi-draw: " << fleet.instances.size() << " instances exceed the "
+                  << max_texels << " texels of a buffer texture" << std::endl;
+        exit(-1);
+    }
+    glGenTextures(1, &instanceTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceStream.buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    renderState.use_program(shaderProgram);
+    glUniform1i(instances_location, 0);
+
+    // Grown as meshes arrive, starting at 64K vertices and indices
+    GLsizei vertex_size = packedVertices ? sizeof(PackedVertex) : VERTEX_SIZE * sizeof(GLfloat);
+    meshArena.init(vertex_size, 1 << 16, 1 << 16);
+    glGenVertexArrays(1, &arenaVAO);
+    bind_arena_buffers();
+
+    size_t max_draws = sceneModels.size() * MESH_MAX_LODS;
+    if (multiDrawIndirect)
+    {
+        commandStream.init(GL_DRAW_INDIRECT_BUFFER, max_draws * sizeof(DrawElementsIndirectCommand));
+        drawStream.init(GL_ARRAY_BUFFER, max_draws * sizeof(DrawRecord));
+    }
+    drawCommands.reserve(max_draws);
+    drawRecords.reserve(max_draws);
+
+    std::cout << "Multi-draw: " << (multiDrawIndirect ? "one glMultiDrawElementsIndirect per frame" : "glDrawElementsInstancedBaseVertex per draw (no GL 4.3 multi-draw indirect)")
+              << std::endl;
+}
+
+// Points the arena VAO at the arena's current buffers (again after they grew)
+void bind_arena_buffers()
+{
+    glBindVertexArray(arenaVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, meshArena.VBO);
+    bind_vertex_attributes();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshArena.EBO);
+
+    // Draw records advance once per draw: no draw has more instances than the fleet. Without
+    // base_instance the attributes stay disabled and take the constant values draw_arena sets.
+    if (multiDrawIndirect)
+    {
+        GLuint divisor = (GLuint)fleet.instances.size();
+        for (int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(draw_model_location + column);
+            glVertexAttribDivisor(draw_model_location + column, divisor);
+        }
+        glEnableVertexAttribArray(draw_first_location);
+        glVertexAttribDivisor(draw_first_location, divisor);
+    }
+    glBindVertexArray(0);
+    renderState.invalidate();
+}
+
+// Multi-draw counterpart of the per-model loop in draw_frame: the commands for every loaded
+// model and level in use are collected first, then submitted in one call
+void draw_arena()
+{
+    drawCommands.clear();
+    drawRecords.clear();
+    GLint instance_texel = (GLint)(instanceOffset / sizeof(vec4));
+    for (size_t i = 0; i < sceneModels.size() && !visibleInstances.empty(); i++)
+    {
+        GpuMesh &gpu = gpuMeshes[sceneModels[i].mesh];
+        if (!gpu.loaded)
+            continue;
+
+        DrawRecord record;
+        mat4x4_mul(record.model, sceneGraph.world[i].matrix, gpu.dequantize);
+        for (int level = 0; level < MESH_MAX_LODS; level++)
+        {
+            const LodGroup &group = lodGroups[level];
+            if (group.count == 0)
+                continue;
+
+            const MeshLod &lod = gpu.lods[std::min(level, gpu.lod_count - 1)];
+            DrawElementsIndirectCommand command;
+            command.count = lod.index_count;
+            command.instance_count = group.count;
+            command.first_index = gpu.arena.first_index + lod.index_offset;
+            command.base_vertex = gpu.arena.base_vertex;
+            command.base_instance = (GLuint)drawRecords.size();
+            record.first_texel = instance_texel + group.first * INSTANCE_TEXELS;
+            drawCommands.push_back(command);
+            drawRecords.push_back(record);
+            submittedTriangles += lod.index_count / 3.0 * group.count;
+        }
+    }
+    if (drawCommands.empty())
+        return;
+
+    renderState.bind_vertex_array(arenaVAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+
+    if (multiDrawIndirect)
+    {
+        GLintptr command_offset, record_offset;
+        void *commands = commandStream.begin_write(command_offset);
+        if (commands)
+            memcpy(commands, drawCommands.data(), drawCommands.size() * sizeof(DrawElementsIndirectCommand));
+        commandStream.end_write();
+        void *records = drawStream.begin_write(record_offset);
+        if (records)
+            memcpy(records, drawRecords.data(), drawRecords.size() * sizeof(DrawRecord));
+        drawStream.end_write();
+
+        glBindBuffer(GL_ARRAY_BUFFER, drawStream.buffer);
+        for (int column = 0; column < 4; column++)
+        {
+            glVertexAttribPointer(draw_model_location + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawRecord),
+                                  (GLvoid *)(record_offset + offsetof(DrawRecord, model) + sizeof(vec4) * column));
+        }
+        glVertexAttribIPointer(draw_first_location, 1, GL_INT, sizeof(DrawRecord), (GLvoid *)(record_offset + offsetof(DrawRecord, first_texel)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandStream.buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid *)command_offset, (GLsizei)drawCommands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        drawCalls++;
+
+        commandStream.fence();
+        drawStream.fence();
+    }
+    else
+    {
+        for (size_t d = 0; d < drawCommands.size(); d++)
+        {
+            const DrawElementsIndirectCommand &command = drawCommands[d];
+            const DrawRecord &record = drawRecords[d];
+            for (int column = 0; column < 4; column++)
+                glVertexAttrib4fv(draw_model_location + column, record.model[column]);
+            glVertexAttribI4i(draw_first_location, record.first_texel, 0, 0, 1);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (GLvoid *)(command.first_index * sizeof(GLuint)),
+                                              command.instance_count, command.base_vertex);
+        }
+        drawCalls += (long)drawCommands.size();
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    renderState.end_frame(drawCommands.size());
+}
+
+// Refits the instance boxes if the scene or the instances moved, then collects the
+// instances touching the view volume of mvp into visibleInstances
+void cull_instances()
+{
+    auto cull_start = std::chrono::steady_clock::now();
+
+    if (boundsDirty)
+    {
+        // Instance-space box of every loaded model under its current world matrix
+        bool empty = true;
+        for (size_t i = 0; i < sceneModels.size(); i++)
+        {
+            const GpuMesh &gpu = gpuMeshes[sceneModels[i].mesh];
+            if (!gpu.loaded)
+                continue;
+
+            Aabb model_bounds;
+            transform_aabb(gpu.bounds, sceneGraph.world[i].matrix, model_bounds);
+            if (empty)
+            {
+                sceneBounds = model_bounds;
+                empty = false;
+            }
+            for (int axis = 0; axis < 3; axis++)
+            {
+                sceneBounds.min[axis] = std::min(sceneBounds.min[axis], model_bounds.min[axis]);
+                sceneBounds.max[axis] = std::max(sceneBounds.max[axis], model_bounds.max[axis]);
+            }
+        }
+        if (empty)
+        {
+            visibleInstances.clear();
+            return;
+        }
+
+        // Built once; afterwards the instance boxes are updated in place and the tree refit
+        std::vector<Aabb> instance_bounds(fleet.instances.size());
+        for (size_t i = 0; i < fleet.instances.size(); i++)
+            transform_aabb(sceneBounds, fleet.instances[i].model, instance_bounds[i]);
+
+        if (instanceBvh.nodes.empty())
+        {
+            instanceBvh.build(instance_bounds);
+        }
+        else
+        {
+            for (size_t i = 0; i < instance_bounds.size(); i++)
+                instanceBvh.update((uint32_t)i, instance_bounds[i]);
+            instanceBvh.refit();
+        }
+        boundsDirty = false;
+    }
+
+    Frustum frustum;
+    extract_frustum(frustum, mvp);
+    visibleInstances.clear();
+    instanceBvh.cull(frustum, visibleInstances);
+    if (occlusionCulling)
+        candidateInstances = visibleInstances;
+    cullDirty = true;
+
+    double cull_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - cull_start).count();
+    long drawn = (long)visibleInstances.size();
+    cullStats.add_frame(drawn, (long)fleet.instances.size() - drawn, cull_us);
+}
+
+// Picks each visible (and deferred) instance's level of detail from the on-screen size of
+// its box and lays out lodGroups for the grouped upload of the visible ones
+void select_lods()
+{
+    instanceLod.resize(fleet.instances.size(), 0);
+    GLsizei counts[MESH_MAX_LODS] = {0};
+
+    for (size_t i = 0; i < visibleInstances.size() + deferredInstances.size(); i++)
+    {
+        bool visible = i < visibleInstances.size();
+        uint32_t index = visible ? visibleInstances[i] : deferredInstances[i - visibleInstances.size()];
+
+        // Ortho projection: the box's extent in normalized device coordinates scales
+        // straight to pixels
+        Aabb screen;
+        transform_aabb(instanceBvh.item_bounds[index], mvp, screen);
+        float size = std::max((screen.max[0] - screen.min[0]) * 0.5f * viewWidth,
+                              (screen.max[1] - screen.min[1]) * 0.5f * viewHeight);
+
+        int level = instanceLod[index];
+        while (level < MESH_MAX_LODS - 1 && size < LOD_SCREEN_SIZES[level] * (1.0f - LOD_HYSTERESIS))
+            level++;
+        while (level > 0 && size > LOD_SCREEN_SIZES[level - 1] * (1.0f + LOD_HYSTERESIS))
+            level--;
+
+        instanceLod[index] = (unsigned char)level;
+        if (visible)
+            counts[level]++;
+    }
+
+    GLsizei first = 0;
+    for (int level = 0; level < MESH_MAX_LODS; level++)
+    {
+        lodGroups[level] = {first, counts[level]};
+        first += counts[level];
+    }
+}
+
+void report_first_frame(std::chrono::steady_clock::time_point program_start, double init_ms)
+{
+    double first_frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - program_start).count();
+    std::cout << "Time to first frame: " << first_frame_ms << " ms (window, GL and shaders ready after "
+              << init_ms << " ms)" << std::endl;
+}
+
+// Renders each pose offscreen and writes it as an image named after output_pattern. GL frames
+// are read back through a ring of pixel buffers and only collected once the GPU is done
+// with them, so rendering runs ahead while earlier frames are encoded on worker threads.
+// Returns false if any frame could not be read back or written
+bool render_turntable(const std::vector<TurntablePose> &poses, const std::string &output_pattern,
+                      HeadlessContext &headless, unsigned software_threads)
+{
+    unsigned encode_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    ImageWriter writer;
+    writer.start(encode_threads, encode_threads * TURNTABLE_IMAGES_PER_THREAD);
+
+    SoftRasterizer rasterizer;
+    ReadbackRing readback;
+    if (softwareRenderer)
+        rasterizer.init(WIDTH, HEIGHT, software_threads);
+    else
+        readback.init(headless.width, headless.height, TURNTABLE_READBACK_SLOTS);
+
+    auto queue_image = [&](std::vector<uint32_t> &pixels, int frame)
+    {
+        std::string filename;
+        turntable_filename(output_pattern, frame, filename);
+        writer.write(filename, std::move(pixels), WIDTH, HEIGHT);
+        pixels = writer.buffer();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> pixels = writer.buffer();
+    int ready_frame = 0;
+
+    // Hands over finished frames until the ring has none ready; a lost frame was already
+    // reported and the ones after it still come out
+    auto drain_readback = [&](bool block_all)
+    {
+        ReadbackStatus status;
+        while ((status = readback.collect(pixels, ready_frame, block_all || readback.full())) != READBACK_NOT_READY)
+        {
+            if (status == READBACK_READY)
+                queue_image(pixels, ready_frame);
+        }
+    };
+
+    for (size_t frame = 0; frame < poses.size(); frame++)
+    {
+        const TurntablePose &pose = poses[frame];
+        rotationX = pose.rotation[0];
+        rotationY = pose.rotation[1];
+        rotationZ = pose.rotation[2];
+        rotationCameraY = pose.rotation_camera_y;
+        zoom = pose.zoom;
+        animationTime += 1.0f / 60.0f;
+        viewDirty = modelDirty = true;
+
+        if (softwareRenderer)
+        {
+            draw_frame_software(rasterizer);
+            pixels.resize((size_t)WIDTH * HEIGHT);
+            for (GLuint y = 0; y < HEIGHT; y++)
+                std::copy_n(&rasterizer.color[(size_t)y * rasterizer.stride], WIDTH, &pixels[(size_t)y * WIDTH]);
+            queue_image(pixels, (int)frame);
+            continue;
+        }
+
+        draw_frame(headless.width, headless.height);
+
+        // Hand over whatever the GPU finished meanwhile; a full ring waits for its oldest frame
+        drain_readback(false);
+        readback.start((int)frame);
+    }
+    if (!softwareRenderer)
+        drain_readback(true);
+
+    auto rendered = std::chrono::steady_clock::now();
+    writer.finish();
+    auto written = std::chrono::steady_clock::now();
+
+    double render_ms = std::chrono::duration<double, std::milli>(rendered - start).count();
+    double total_ms = std::chrono::duration<double, std::milli>(written - start).count();
+    std::cout << "Turntable: " << poses.size() << " frames in " << total_ms << " ms, "
+              << poses.size() * 1000.0 / total_ms << " frames/s written (" << poses.size() * 1000.0 / render_ms
+              << " frames/s rendered and read back)" << std::endl;
+    if (!softwareRenderer)
+    {
+        readback.print_stats();
+        readback.destroy();
+    }
+    writer.print_stats();
+    return readback.failures == 0 && writer.failures == 0;
+}
+
+// Camera and projection into the global mvp
+void build_view_projection(float ratio)
+{
+    mat4x4 m, v, p, mEye;
+
+    mat4x4_identity(mvp);
+    mat4x4_identity(m);
+    mat4x4_identity(v);
+    mat4x4_identity(p);
+    mat4x4_identity(mEye);
+
+    mat4x4_ortho(p, -ratio - zoom, ratio + zoom, -1.f - zoom, 1.f + zoom, 100.f, -100.f);
+
+    vec3 eye = {0.f, 0.f, 1.f};
+    vec3 center = {0.f, 0.f, 0.f};
+    vec3 up = {0.f, 1.f, 0.f};
+    mat4x4_look_at(v, eye, center, up);
+
+    mat4x4_rotate_Y(m, m, rotationCameraY);
+
+    // For rotating camera with center at eye
+    mat4x4_translate(mEye, -eye[0], -eye[1], -eye[2]);
+    mat4x4_mul(m, m, mEye);
+    mat4x4_rotate_X(m, m, centerX);
+    mat4x4_rotate_Y(m, m, centerY);
+    mat4x4_rotate_Z(m, m, centerZ);
+    mat4x4_translate(mEye, eye[0], eye[1], eye[2]);
+    mat4x4_mul(m, m, mEye);
+
+    mat4x4_mul(v, v, m);
+    mat4x4_mul(mvp, p, v);
+
+    viewDirty = false;
+}
+
+// Model orientation into the global rot_obj
+void build_model_rotation()
+{
+    mat4x4_identity(rot_obj);
+    mat4x4_rotate_X(rot_obj, rot_obj, rotationX);
+    mat4x4_rotate_Y(rot_obj, rot_obj, rotationY);
+    mat4x4_rotate_Z(rot_obj, rot_obj, rotationZ);
+
+    // Each free-standing model spins about its own origin, then sits at its scene placement;
+    // attached parts follow through the scene graph
+    for (size_t i = 0; i < sceneModels.size(); i++)
+    {
+        if (sceneModels[i].attached)
+            continue;
+
+        mat4x4 model_local;
+        mat4x4_mul(model_local, sceneModels[i].placement, rot_obj);
+        sceneGraph.set_local((int)i, model_local);
+    }
+
+    modelDirty = false;
+}
+
+// Called when the window contents need repainting (exposed, uncovered, ...)
+void refresh_callback(GLFWwindow *window)
+{
+    redrawNeeded = true;
+}
+
 // Is called whenever a key is pressed/released via GLFW
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode)
 {
+    GLuint previousProgram = activeProgram;
+
+    // Motion keys only report press and release; the simulation moves while they are held
+    if (action != GLFW_REPEAT)
+    {
+        for (const KeyControl &control : KEY_CONTROLS)
+        {
+            if (control.key == key)
+                simulation.set_control(sim_control(control.axis, control.increase), action == GLFW_PRESS);
+        }
+    }
+
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GLFW_TRUE);
-    else if (key == GLFW_KEY_RIGHT && action == GLFW_REPEAT)
-        rotationY += 0.05;
-    else if (key == GLFW_KEY_LEFT && action == GLFW_REPEAT)
-        rotationY -= 0.05;
-    else if (key == GLFW_KEY_UP && action == GLFW_REPEAT)
-        rotationX += 0.05;
-    else if (key == GLFW_KEY_DOWN && action == GLFW_REPEAT)
-        rotationX -= 0.05;
-    else if (key == GLFW_KEY_Z && action == GLFW_REPEAT)
-        rotationZ += 0.05;
-    else if (key == GLFW_KEY_X && action == GLFW_REPEAT)
-        rotationZ -= 0.05;
-    else if (key == GLFW_KEY_W && action == GLFW_REPEAT)
-        zoom -= 0.05;
-    else if (key == GLFW_KEY_S && action == GLFW_REPEAT)
-        zoom += 0.05;
-    else if (key == GLFW_KEY_C && action == GLFW_REPEAT)
-        rotationCameraY -= 0.05;
-    else if (key == GLFW_KEY_V && action == GLFW_REPEAT)
-        rotationCameraY += 0.05;
-    else if (key == GLFW_KEY_I && action == GLFW_REPEAT)
-        centerX += 0.05;
-    else if (key == GLFW_KEY_K && action == GLFW_REPEAT)
-        centerX -= 0.05;
-    else if (key == GLFW_KEY_L && action == GLFW_REPEAT)
-        centerY += 0.05;
-    else if (key == GLFW_KEY_J && action == GLFW_REPEAT)
-        centerY -= 0.05;
-    else if (key == GLFW_KEY_N && action == GLFW_REPEAT)
-        centerZ += 0.05;
-    else if (key == GLFW_KEY_M && action == GLFW_REPEAT)
-        centerZ -= 0.05;
     else if (key == GLFW_KEY_O && action == GLFW_PRESS)
     {
         if (shaderAttached)
@@ -240,48 +1783,42 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
     }
     else if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
-        rotationX = 0;
-        rotationY = 0;
-        rotationZ = 0;
-        zoom = 0;
-        centerY = 0;
-        centerX = 0;
-        centerZ = 0;
-        rotationCameraY = 0;
+        simulation.reset();
         shaderAttached = true;
         activeProgram = shaderProgram;
     }
+
+    if (previousProgram != activeProgram)
+        redrawNeeded = true;
 }
 
-void read_vertices(GLfloat *vertices, std::string filename)
+// Takes the model and camera state from the simulation, interpolated to the present
+// moment, and invalidates only the matrices whose inputs changed
+void apply_simulation()
 {
-    std::ifstream vertices_file;
-    std::string line;
-    int line_count = 0, LINE_SIZE = 6;
+    SimState state;
+    if (!simulation.sample(std::chrono::steady_clock::now(), state))
+        return;
 
-    vertices_file.open(filename);
-    if (vertices_file.is_open())
-    {
-        while (std::getline(vertices_file, line))
-        {
-            std::istringstream in(line);
-
-            if (line[0] != '#')
-            {
-                float x, y, z, r, g, b;
-                in >> x >> y >> z >> r >> g >> b;
+    float previousModel[3] = {rotationX, rotationY, rotationZ};
+    float previousView[5] = {rotationCameraY, zoom, centerX, centerY, centerZ};
 
-                vertices[line_count * LINE_SIZE + 0] = x;
-                vertices[line_count * LINE_SIZE + 1] = y;
-                vertices[line_count * LINE_SIZE + 2] = z;
-                vertices[line_count * LINE_SIZE + 3] = r;
-                vertices[line_count * LINE_SIZE + 4] = g;
-                vertices[line_count * LINE_SIZE + 5] = b;
+    rotationX = state.value[AXIS_ROTATION_X];
+    rotationY = state.value[AXIS_ROTATION_Y];
+    rotationZ = state.value[AXIS_ROTATION_Z];
+    rotationCameraY = state.value[AXIS_CAMERA_Y];
+    zoom = state.value[AXIS_ZOOM];
+    centerX = state.value[AXIS_CENTER_X];
+    centerY = state.value[AXIS_CENTER_Y];
+    centerZ = state.value[AXIS_CENTER_Z];
+    animationTime = state.time;
 
-                line_count++;
-            }
-        }
-    }
+    float currentModel[3] = {rotationX, rotationY, rotationZ};
+    float currentView[5] = {rotationCameraY, zoom, centerX, centerY, centerZ};
+    if (memcmp(previousModel, currentModel, sizeof(currentModel)) != 0)
+        modelDirty = true;
+    if (memcmp(previousView, currentView, sizeof(currentView)) != 0)
+        viewDirty = true;
 }
 
 GLFWwindow *init()
@@ -300,6 +1837,7 @@ GLFWwindow *init()
 
     // Set the required callback functions
     glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowRefreshCallback(window, refresh_callback);
 
     // Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
     glewExperimental = GL_TRUE;
@@ -309,27 +1847,6 @@ GLFWwindow *init()
     return window;
 }
 
-GLuint compile_shader(const GLchar *shaderSource, GLenum type)
-{
-    // Compile shader
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &shaderSource, NULL);
-    glCompileShader(shader);
-
-    // Check for compile time errors
-    GLint success;
-    GLchar infoLog[512];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        std::cout << "Shader compilation failed\n"
-                  << infoLog << std::endl;
-    }
-
-    return shader;
-}
-
 void printHelp(){
 
 std::cout<< "=========================================================     " << std::endl;
@@ -0,0 +1,113 @@
+#include "mesh.h"
+
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+static const char *skip_blanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+static const char *line_end(const char *p, const char *end)
+{
+    const char *newline = (const char *)memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// A vertex line is any line that is neither blank nor a '#' comment
+static bool is_vertex_line(const char *p, const char *eol)
+{
+    p = skip_blanks(p, eol);
+    return p < eol && *p != '#';
+}
+
+// Parses "x y z r g b" from [p, eol) into out. Returns false on anything else.
+static bool parse_vertex(const char *p, const char *eol, GLfloat *out)
+{
+    for (int i = 0; i < VERTEX_SIZE; i++)
+    {
+        p = skip_blanks(p, eol);
+        if (p < eol && *p == '+')
+            p++;
+
+        std::from_chars_result result = std::from_chars(p, eol, out[i]);
+        if (result.ec != std::errc())
+            return false;
+        p = result.ptr;
+    }
+
+    return skip_blanks(p, eol) == eol;
+}
+
+Mesh read_vertices(const std::string &filename)
+{
+    Mesh mesh;
+    MappedFile file;
+
+    if (!file.open(filename))
+    {
+        std::cout << "Cannot open vertex file " << filename << std::endl;
+        return mesh;
+    }
+
+    const char *begin = file.data, *end = file.data + file.size;
+
+    // First pass only counts vertices so the buffer is allocated exactly once
+    size_t line_count = 0;
+    for (const char *p = begin; p < end;)
+    {
+        const char *eol = line_end(p, end);
+        if (is_vertex_line(p, eol))
+            line_count++;
+        p = eol + 1;
+    }
+
+    mesh.vertices.resize(line_count * VERTEX_SIZE);
+
+    size_t vertex = 0, line_number = 0;
+    for (const char *p = begin; p < end;)
+    {
+        const char *eol = line_end(p, end);
+        line_number++;
+
+        if (is_vertex_line(p, eol))
+        {
+            if (!parse_vertex(p, eol, &mesh.vertices[vertex * VERTEX_SIZE]))
+            {
+                std::cout << filename << ":" << line_number << ": expected 6 floats per vertex" << std::endl;
+                return Mesh();
+            }
+            vertex++;
+        }
+
+        p = eol + 1;
+    }
+
+    mesh.vertex_count = (GLsizei)vertex;
+    mesh.compute_bounds();
+    return mesh;
+}
+
+void Mesh::compute_bounds()
+{
+    const GLfloat *v = data();
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bounds_min[axis] = vertex_count > 0 ? v[axis] : 0;
+        bounds_max[axis] = bounds_min[axis];
+    }
+
+    for (GLsizei i = 0; i < vertex_count; i++, v += VERTEX_SIZE)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (v[axis] < bounds_min[axis])
+                bounds_min[axis] = v[axis];
+            if (v[axis] > bounds_max[axis])
+                bounds_max[axis] = v[axis];
+        }
+    }
+}
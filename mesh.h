@@ -0,0 +1,175 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include "mapped_file.h"
+
+// Number of floats per vertex: position (x, y, z) followed by color (r, g, b)
+const int VERTEX_SIZE = 6;
+
+// Levels of detail: the full mesh plus simplified versions aiming at these fractions of
+// its triangles. Meshes that can't be simplified that far get fewer levels.
+const int MESH_MAX_LODS = 4;
+const float LOD_TRIANGLE_RATIOS[MESH_MAX_LODS] = {1.0f, 0.5f, 0.25f, 0.1f};
+
+// One level of detail: a range of the mesh's index buffer over the shared vertices, and
+// its approximate geometric error as a fraction of the mesh's largest extent
+struct MeshLod
+{
+    GLuint index_offset;
+    GLsizei index_count;
+    GLfloat error;
+};
+
+// Vertex data for one model. The arrays either live in `vertices`/`indices` (built from
+// text), directly inside a memory-mapped binary cache file, or in the executable's
+// read-only data for embedded meshes, so uploads never copy them.
+// load_mesh() always indexes meshes and every draw path uses indexed draws. The levels of
+// detail are listed in lods; index_count covers all of them.
+struct Mesh
+{
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    std::unique_ptr<MappedFile> mapping;
+    size_t mapping_offset = 0;
+    size_t index_mapping_offset = 0;
+    const GLfloat *static_vertices = nullptr;
+    const GLuint *static_indices = nullptr;
+
+    GLsizei vertex_count = 0;
+    GLsizei index_count = 0;
+    GLfloat bounds_min[3] = {0, 0, 0};
+    GLfloat bounds_max[3] = {0, 0, 0};
+
+    MeshLod lods[MESH_MAX_LODS] = {};
+    int lod_count = 0;
+
+    const GLfloat *data() const
+    {
+        if (static_vertices)
+            return static_vertices;
+        return mapping ? (const GLfloat *)(mapping->data + mapping_offset) : vertices.data();
+    }
+
+    const GLuint *index_data() const
+    {
+        if (static_indices)
+            return static_indices;
+        return mapping ? (const GLuint *)(mapping->data + index_mapping_offset) : indices.data();
+    }
+
+    size_t byte_size() const
+    {
+        return (size_t)vertex_count * VERTEX_SIZE * sizeof(GLfloat);
+    }
+
+    size_t index_byte_size() const
+    {
+        return (size_t)index_count * sizeof(GLuint);
+    }
+
+    void compute_bounds();
+};
+
+// Compact vertex layout: positions as 16-bit unsigned normalized values over the mesh's
+// bounding box, colors as normalized bytes. 12 bytes per vertex instead of 24; the shader
+// sees positions in [0, 1] and the bounds have to be applied by the model transform.
+struct PackedVertex
+{
+    GLushort position[3];
+    GLushort padding;
+    GLubyte color[4];
+};
+
+// Quantizes every vertex of mesh into the packed layout (uses bounds_min/bounds_max)
+std::vector<PackedVertex> pack_vertices(const Mesh &mesh);
+
+// Post-transform vertex cache efficiency of an index buffer, simulated with a FIFO cache.
+// ACMR = transformed vertices per triangle (0.5 is ideal, 3 is no reuse),
+// ATVR = transformed vertices per unique vertex (1 is ideal).
+struct VertexCacheStats
+{
+    float acmr;
+    float atvr;
+};
+
+struct MeshIndexStats
+{
+    VertexCacheStats unindexed;
+    VertexCacheStats welded;
+    VertexCacheStats optimized;
+};
+
+// FIFO size used for the ACMR/ATVR estimates, a typical post-transform cache size
+const int VERTEX_CACHE_SIMULATION_SIZE = 16;
+
+// Reads every "x y z r g b" line of a vertex file, skipping '#' comments and blank lines.
+// The file is memory-mapped and scanned in place with std::from_chars (locale independent).
+// Returns an empty mesh and prints the reason when the file can't be read or is malformed.
+Mesh read_vertices(const std::string &filename);
+
+// Welds identical position+color vertices of a non-indexed mesh into unique vertices plus
+// an index buffer, reorders the triangles for the post-transform vertex cache and the
+// vertices for fetch locality.
+MeshIndexStats index_mesh(Mesh &mesh);
+
+// Reorders triangles of an indexed triangle list for vertex cache reuse (Forsyth's
+// linear-speed algorithm)
+void optimize_vertex_cache(std::vector<GLuint> &indices, GLsizei vertex_count);
+
+VertexCacheStats vertex_cache_stats(const GLuint *indices, size_t index_count, GLsizei vertex_count, int cache_size);
+
+// Simplifies an indexed triangle list to about target_index_count indices by collapsing
+// edges in order of their quadric error over position and color (Garland & Heckbert).
+// Vertices only move onto existing vertices, so the result indexes the same vertex array
+// and keeps its colors; border and color-seam vertices stay fixed. result_error receives
+// the largest collapse error, as a fraction of the mesh extent.
+std::vector<GLuint> simplify_mesh(const GLfloat *vertices, GLsizei vertex_count, const GLuint *indices, size_t index_count,
+                                  size_t target_index_count, float *result_error = nullptr);
+
+// Appends simplified levels (LOD_TRIANGLE_RATIOS) after the full index buffer of an indexed
+// mesh held in memory and fills in lods; returns the number of levels
+int build_lods(Mesh &mesh);
+
+// Loads a vertex file through its binary cache ("<file>.mesh" next to it). The cache is
+// mapped and used as-is while the source size and modification time still match;
+// otherwise the text is parsed, indexed with index_mesh(), simplified into levels of
+// detail with build_lods() and the cache rewritten.
+// Names starting with EMBEDDED_MESH_PREFIX are looked up with find_embedded_mesh() instead.
+Mesh load_mesh(const std::string &filename);
+
+// Binary cache access, exposed for tools that want to control caching themselves
+std::string mesh_cache_path(const std::string &filename);
+bool read_mesh_cache(const std::string &filename, Mesh &mesh);
+bool write_mesh_cache(const std::string &filename, const Mesh &mesh);
+
+// A mesh compiled into the executable by `make embedded`: the arrays load_mesh() would
+// produce for a vertex file (indexed, with its levels of detail), as generated constants
+struct EmbeddedMesh
+{
+    const char *name;
+    const GLfloat *vertices;
+    GLsizei vertex_count;
+    const GLuint *indices;
+    GLsizei index_count;
+    GLfloat bounds_min[3];
+    GLfloat bounds_max[3];
+    MeshLod lods[MESH_MAX_LODS];
+    int lod_count;
+};
+
+// "embedded:airplane" selects the mesh generated from airplane.txt
+const char EMBEDDED_MESH_PREFIX[] = "embedded:";
+
+// Points mesh at the embedded arrays named name, without copying them. Returns false if
+// no mesh of that name was compiled in (builds without EMBEDDED_MESHES have none).
+bool find_embedded_mesh(const std::string &name, Mesh &mesh);
+
+#endif
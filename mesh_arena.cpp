@@ -0,0 +1,112 @@
+#include "mesh_arena.h"
+
+#include <algorithm>
+#include <iostream>
+
+bool multi_draw_indirect_supported()
+{
+    return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
+
+// Storage of size bytes holding the first used bytes of previous (which is deleted).
+// Buffers are created and filled through the copy targets, which no VAO records.
+static GLuint regrow(GLuint previous, size_t used, size_t size)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    if (previous)
+    {
+        if (used > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, previous);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &previous);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+
+void MeshArena::init(GLsizei size_per_vertex, GLuint initial_vertices, GLuint initial_indices)
+{
+    vertex_size = size_per_vertex;
+    vertex_capacity = std::max(initial_vertices, 1u);
+    index_capacity = std::max(initial_indices, 1u);
+    vertices_used = indices_used = 0;
+    VBO = regrow(0, 0, (size_t)vertex_capacity * vertex_size);
+    EBO = regrow(0, 0, (size_t)index_capacity * sizeof(GLuint));
+}
+
+void MeshArena::destroy()
+{
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VBO = EBO = 0;
+}
+
+bool MeshArena::allocate(ArenaRange &range, GLuint vertex_count, GLuint index_count)
+{
+    // A reload that is no bigger than before is written over its old place
+    if (range.vertex_count > 0 && vertex_count <= range.vertex_count && index_count <= range.index_count)
+    {
+        bytes_abandoned += (size_t)(range.vertex_count - vertex_count) * vertex_size +
+                           (size_t)(range.index_count - index_count) * sizeof(GLuint);
+        range.vertex_count = vertex_count;
+        range.index_count = index_count;
+        return false;
+    }
+    bytes_abandoned += (size_t)range.vertex_count * vertex_size + (size_t)range.index_count * sizeof(GLuint);
+
+    bool grown = false;
+    if (vertices_used + vertex_count > vertex_capacity)
+    {
+        GLuint capacity = vertex_capacity;
+        while (vertices_used + vertex_count > capacity)
+            capacity *= 2;
+        VBO = regrow(VBO, (size_t)vertices_used * vertex_size, (size_t)capacity * vertex_size);
+        bytes_copied += (size_t)vertices_used * vertex_size;
+        vertex_capacity = capacity;
+        grown = true;
+    }
+    if (indices_used + index_count > index_capacity)
+    {
+        GLuint capacity = index_capacity;
+        while (indices_used + index_count > capacity)
+            capacity *= 2;
+        EBO = regrow(EBO, (size_t)indices_used * sizeof(GLuint), (size_t)capacity * sizeof(GLuint));
+        bytes_copied += (size_t)indices_used * sizeof(GLuint);
+        index_capacity = capacity;
+        grown = true;
+    }
+    if (grown)
+        grows++;
+
+    range.base_vertex = (GLint)vertices_used;
+    range.first_index = indices_used;
+    range.vertex_count = vertex_count;
+    range.index_count = index_count;
+    vertices_used += vertex_count;
+    indices_used += index_count;
+    return grown;
+}
+
+void MeshArena::write(const ArenaRange &range, const void *vertices, const GLuint *indices)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)range.base_vertex * vertex_size,
+                    (GLsizeiptr)range.vertex_count * vertex_size, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)range.first_index * sizeof(GLuint),
+                    (GLsizeiptr)range.index_count * sizeof(GLuint), indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void MeshArena::print_stats() const
+{
+    std::cout << "Mesh arena: " << vertices_used << " of " << vertex_capacity << " vertices, " << indices_used
+              << " of " << index_capacity << " indices, " << grows << " grows (" << bytes_copied / 1024.0
+              << " KB copied), " << bytes_abandoned / 1024.0 << " KB abandoned by reloads" << std::endl;
+}
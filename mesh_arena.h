@@ -0,0 +1,64 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+#include <cstddef>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER, one per draw
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// Where a mesh sits in the arena. Its indices stay relative to its own vertices;
+// base_vertex is added to them at draw time.
+struct ArenaRange
+{
+    GLint base_vertex = 0;
+    GLuint first_index = 0;
+    GLuint vertex_count = 0, index_count = 0;
+};
+
+// Whether the context can submit a whole command buffer with one glMultiDrawElementsIndirect
+// and honors base_instance (GL 4.3, or ARB_multi_draw_indirect with ARB_base_instance).
+// Plain GL 3.3 has to issue one glDrawElementsInstancedBaseVertex per command instead.
+bool multi_draw_indirect_supported();
+
+// One vertex buffer and one index buffer shared by every mesh of the scene, so draws of
+// different meshes need neither a VAO nor a buffer switch in between and can be batched
+// into a single multi-draw. Meshes are appended; when one no longer fits, the storage
+// doubles and the used part is copied over on the GPU.
+struct MeshArena
+{
+    GLuint VBO = 0, EBO = 0;
+    GLsizei vertex_size = 0; // bytes per vertex, the same layout for every mesh
+    GLuint vertices_used = 0, indices_used = 0;
+    GLuint vertex_capacity = 0, index_capacity = 0;
+
+    // Counters, see print_stats()
+    long grows = 0;
+    size_t bytes_copied = 0;   // moved on the GPU while growing
+    size_t bytes_abandoned = 0; // left behind by meshes that outgrew their range
+
+    void init(GLsizei vertex_size, GLuint vertex_capacity, GLuint index_capacity);
+    void destroy();
+
+    // Makes range big enough for the given counts: a mesh that still fits keeps its place,
+    // anything else goes at the end. Returns true when the buffers were replaced, in which
+    // case every VAO reading them has to be pointed at VBO and EBO again.
+    bool allocate(ArenaRange &range, GLuint vertex_count, GLuint index_count);
+
+    // Fills range (as sized by allocate) with vertices and indices
+    void write(const ArenaRange &range, const void *vertices, const GLuint *indices);
+
+    void print_stats() const;
+};
+
+#endif
@@ -0,0 +1,252 @@
+#include "mesh.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout of the binary cache:
+//   MeshCacheHeader | padding | vertex_count * stride bytes of vertices at vertex_offset
+//                   | padding | index_count GLuint indices at index_offset
+// The index buffer holds every level of detail back to back, as listed in the header.
+// Everything is stored in native byte order; a file from another architecture fails the
+// magic/version check and is simply rebuilt.
+static const char MESH_CACHE_MAGIC[4] = {'W', 'W', 'A', 'M'};
+static const uint32_t MESH_CACHE_VERSION = 3;
+static const uint32_t MESH_CACHE_ALIGNMENT = 64;
+
+enum MeshAttributeSemantic : uint32_t
+{
+    ATTRIBUTE_POSITION = 0,
+    ATTRIBUTE_COLOR = 1,
+};
+
+struct MeshCacheAttribute
+{
+    uint32_t semantic;
+    uint32_t components;
+    uint32_t type; // GLenum of each component
+    uint32_t offset;
+};
+
+struct MeshCacheLod
+{
+    uint32_t index_offset; // in indices from the start of the index block
+    uint32_t index_count;
+    float error;
+    uint32_t reserved;
+};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+
+    // Identity of the text file the cache was built from
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+
+    uint32_t vertex_count;
+    uint32_t stride;
+    uint32_t attribute_count;
+    uint32_t reserved;
+    MeshCacheAttribute attributes[2];
+
+    float bounds_min[3];
+    float bounds_max[3];
+    uint64_t vertex_offset;
+
+    uint32_t index_count;
+    uint32_t index_type; // GLenum, always GL_UNSIGNED_INT
+    uint64_t index_offset;
+
+    uint32_t lod_count;
+    uint32_t reserved_lod;
+    MeshCacheLod lods[MESH_MAX_LODS];
+};
+
+static const MeshCacheAttribute FLOAT_LAYOUT[2] = {
+    {ATTRIBUTE_POSITION, 3, GL_FLOAT, 0},
+    {ATTRIBUTE_COLOR, 3, GL_FLOAT, 3 * sizeof(GLfloat)},
+};
+
+static bool source_identity(const std::string &filename, uint64_t &size, int64_t &mtime_ns)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return false;
+
+    size = (uint64_t)st.st_size;
+    mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+static bool write_block(FILE *out, const void *data, size_t bytes)
+{
+    return bytes == 0 || fwrite(data, bytes, 1, out) == 1;
+}
+
+std::string mesh_cache_path(const std::string &filename)
+{
+    return filename + ".mesh";
+}
+
+bool read_mesh_cache(const std::string &filename, Mesh &mesh)
+{
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    if (!source_identity(filename, source_size, source_mtime_ns))
+        return false;
+
+    std::unique_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(mesh_cache_path(filename)) || file->size < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, file->data, sizeof(header));
+
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != MESH_CACHE_VERSION ||
+        header.source_size != source_size ||
+        header.source_mtime_ns != source_mtime_ns)
+        return false;
+
+    // Only the float layout is produced today; anything else means a newer writer
+    if (header.stride != VERTEX_SIZE * sizeof(GLfloat) ||
+        header.attribute_count != 2 ||
+        memcmp(header.attributes, FLOAT_LAYOUT, sizeof(FLOAT_LAYOUT)) != 0)
+        return false;
+
+    uint64_t vertex_bytes = (uint64_t)header.vertex_count * header.stride;
+    uint64_t index_bytes = (uint64_t)header.index_count * sizeof(GLuint);
+    if (header.index_type != GL_UNSIGNED_INT ||
+        header.vertex_offset % sizeof(GLfloat) != 0 ||
+        header.vertex_offset > file->size ||
+        vertex_bytes > file->size - header.vertex_offset ||
+        header.index_offset % sizeof(GLuint) != 0 ||
+        header.index_offset > file->size ||
+        index_bytes > file->size - header.index_offset ||
+        header.lod_count < 1 || header.lod_count > MESH_MAX_LODS)
+        return false;
+
+    for (uint32_t level = 0; level < header.lod_count; level++)
+    {
+        const MeshCacheLod &lod = header.lods[level];
+        if (lod.index_offset > header.index_count || lod.index_count > header.index_count - lod.index_offset)
+            return false;
+    }
+
+    mesh = Mesh();
+    mesh.mapping = std::move(file);
+    mesh.mapping_offset = header.vertex_offset;
+    mesh.index_mapping_offset = header.index_offset;
+    mesh.vertex_count = (GLsizei)header.vertex_count;
+    mesh.index_count = (GLsizei)header.index_count;
+    memcpy(mesh.bounds_min, header.bounds_min, sizeof(mesh.bounds_min));
+    memcpy(mesh.bounds_max, header.bounds_max, sizeof(mesh.bounds_max));
+    mesh.lod_count = (int)header.lod_count;
+    for (int level = 0; level < mesh.lod_count; level++)
+        mesh.lods[level] = {header.lods[level].index_offset, (GLsizei)header.lods[level].index_count, header.lods[level].error};
+    return true;
+}
+
+bool write_mesh_cache(const std::string &filename, const Mesh &mesh)
+{
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+
+    int64_t source_mtime_ns;
+    if (!source_identity(filename, header.source_size, source_mtime_ns))
+        return false;
+
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.source_mtime_ns = source_mtime_ns;
+    header.vertex_count = (uint32_t)mesh.vertex_count;
+    header.stride = VERTEX_SIZE * sizeof(GLfloat);
+    header.attribute_count = 2;
+    memcpy(header.attributes, FLOAT_LAYOUT, sizeof(FLOAT_LAYOUT));
+    memcpy(header.bounds_min, mesh.bounds_min, sizeof(header.bounds_min));
+    memcpy(header.bounds_max, mesh.bounds_max, sizeof(header.bounds_max));
+    header.vertex_offset = align_offset(sizeof(header));
+    header.index_count = (uint32_t)mesh.index_count;
+    header.index_type = GL_UNSIGNED_INT;
+    header.index_offset = align_offset(header.vertex_offset + mesh.byte_size());
+    header.lod_count = (uint32_t)mesh.lod_count;
+    for (int level = 0; level < mesh.lod_count; level++)
+        header.lods[level] = {mesh.lods[level].index_offset, (uint32_t)mesh.lods[level].index_count, mesh.lods[level].error, 0};
+
+    // Write next to the final name and rename, so a reader never maps a half-written cache
+    std::string path = mesh_cache_path(filename);
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    FILE *out = fopen(temp_path.c_str(), "wb");
+    if (!out)
+        return false;
+
+    char padding[MESH_CACHE_ALIGNMENT] = {0};
+    bool ok = write_block(out, &header, sizeof(header)) &&
+              write_block(out, padding, header.vertex_offset - sizeof(header)) &&
+              write_block(out, mesh.data(), mesh.byte_size()) &&
+              write_block(out, padding, header.index_offset - header.vertex_offset - mesh.byte_size()) &&
+              write_block(out, mesh.index_data(), mesh.index_byte_size());
+    ok = fclose(out) == 0 && ok;
+
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+Mesh load_mesh(const std::string &filename)
+{
+    Mesh mesh;
+
+    // Meshes compiled into the executable need no file at all
+    size_t prefix_length = strlen(EMBEDDED_MESH_PREFIX);
+    if (filename.compare(0, prefix_length, EMBEDDED_MESH_PREFIX) == 0)
+    {
+        find_embedded_mesh(filename.substr(prefix_length), mesh);
+        return mesh;
+    }
+
+    if (read_mesh_cache(filename, mesh))
+        return mesh;
+
+    mesh = read_vertices(filename);
+    if (mesh.vertex_count == 0)
+        return mesh;
+
+    GLsizei source_count = mesh.vertex_count;
+    MeshIndexStats stats = index_mesh(mesh);
+    build_lods(mesh);
+
+    // Built as one string so logs from parallel loads don't interleave
+    std::ostringstream log;
+    log << filename << ": " << source_count << " -> " << mesh.vertex_count << " vertices, "
+        << mesh.lods[0].index_count / 3 << " triangles\n";
+    log << std::setprecision(3) << "  ACMR " << stats.unindexed.acmr << " (arrays) / " << stats.welded.acmr << " (welded) -> "
+        << stats.optimized.acmr << ", ATVR " << stats.unindexed.atvr << " / " << stats.welded.atvr
+        << " -> " << stats.optimized.atvr << "\n";
+    log << "  LOD triangles";
+    for (int level = 0; level < mesh.lod_count; level++)
+        log << (level ? ", " : " ") << mesh.lods[level].index_count / 3 << " (error " << mesh.lods[level].error << ")";
+    log << "\n";
+
+    if (!write_mesh_cache(filename, mesh))
+        log << "Cannot write mesh cache " << mesh_cache_path(filename) << "\n";
+
+    std::cout << log.str() << std::flush;
+    return mesh;
+}
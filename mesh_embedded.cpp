@@ -0,0 +1,45 @@
+#include "mesh.h"
+
+#include <cstring>
+#include <iostream>
+
+// Generated by `make embedded` from the vertex files (see embed_meshes.cpp); it defines
+// EMBEDDED_MESH_TABLE. Regular builds link an empty table.
+#ifdef EMBEDDED_MESHES
+#include "embedded/meshes.h"
+#else
+static const EmbeddedMesh *const EMBEDDED_MESH_TABLE[] = {nullptr};
+#endif
+
+// The table ends with nullptr, so a build without embedded meshes has just that entry
+static const size_t EMBEDDED_MESH_COUNT = sizeof(EMBEDDED_MESH_TABLE) / sizeof(*EMBEDDED_MESH_TABLE) - 1;
+
+bool find_embedded_mesh(const std::string &name, Mesh &mesh)
+{
+    for (const EmbeddedMesh *const *entry = EMBEDDED_MESH_TABLE; *entry; entry++)
+    {
+        const EmbeddedMesh &embedded = **entry;
+        if (name != embedded.name)
+            continue;
+
+        mesh = Mesh();
+        mesh.static_vertices = embedded.vertices;
+        mesh.static_indices = embedded.indices;
+        mesh.vertex_count = embedded.vertex_count;
+        mesh.index_count = embedded.index_count;
+        memcpy(mesh.bounds_min, embedded.bounds_min, sizeof(mesh.bounds_min));
+        memcpy(mesh.bounds_max, embedded.bounds_max, sizeof(mesh.bounds_max));
+        mesh.lod_count = embedded.lod_count;
+        for (int level = 0; level < embedded.lod_count; level++)
+            mesh.lods[level] = embedded.lods[level];
+        return true;
+    }
+
+    std::cout << "No embedded mesh named " << name << " (";
+    if (EMBEDDED_MESH_COUNT == 0)
+        std::cout << "build with make embedded to compile them in";
+    for (const EmbeddedMesh *const *entry = EMBEDDED_MESH_TABLE; *entry; entry++)
+        std::cout << (entry == EMBEDDED_MESH_TABLE ? "available: " : ", ") << (*entry)->name;
+    std::cout << ")" << std::endl;
+    return false;
+}
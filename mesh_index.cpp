@@ -0,0 +1,277 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+
+struct VertexKey
+{
+    GLfloat v[VERTEX_SIZE];
+
+    bool operator==(const VertexKey &other) const
+    {
+        return memcmp(v, other.v, sizeof(v)) == 0;
+    }
+};
+
+struct VertexKeyHash
+{
+    size_t operator()(const VertexKey &key) const
+    {
+        // FNV-1a over the raw float bits
+        uint64_t hash = 14695981039346656037ull;
+        const unsigned char *bytes = (const unsigned char *)key.v;
+        for (size_t i = 0; i < sizeof(key.v); i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return (size_t)hash;
+    }
+};
+
+// Forsyth scoring parameters, see "Linear-Speed Vertex Cache Optimisation"
+const int CACHE_SIZE = 32;
+const int MAX_VALENCE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+struct ScoreTable
+{
+    float cache[CACHE_SIZE];
+    float valence[MAX_VALENCE + 1];
+
+    ScoreTable()
+    {
+        for (int i = 0; i < CACHE_SIZE; i++)
+        {
+            if (i < 3)
+                cache[i] = LAST_TRIANGLE_SCORE;
+            else
+                cache[i] = powf(1.0f - (i - 3) * (1.0f / (CACHE_SIZE - 3)), CACHE_DECAY_POWER);
+        }
+
+        valence[0] = 0;
+        for (int i = 1; i <= MAX_VALENCE; i++)
+            valence[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+
+    float score(int cache_position, unsigned remaining) const
+    {
+        if (remaining == 0)
+            return -1.0f;
+
+        float result = valence[std::min(remaining, (unsigned)MAX_VALENCE)];
+        if (cache_position >= 0)
+            result += cache[cache_position];
+        return result;
+    }
+};
+
+} // namespace
+
+VertexCacheStats vertex_cache_stats(const GLuint *indices, size_t index_count, GLsizei vertex_count, int cache_size)
+{
+    std::vector<size_t> inserted_at(vertex_count, 0);
+    size_t misses = 0;
+
+    // A vertex is still cached if fewer than cache_size misses happened since it was loaded
+    for (size_t i = 0; i < index_count; i++)
+    {
+        GLuint index = indices[i];
+        if (inserted_at[index] == 0 || misses - (inserted_at[index] - 1) >= (size_t)cache_size)
+        {
+            misses++;
+            inserted_at[index] = misses;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = index_count ? (float)misses / (index_count / 3) : 0;
+    stats.atvr = vertex_count ? (float)misses / vertex_count : 0;
+    return stats;
+}
+
+void optimize_vertex_cache(std::vector<GLuint> &indices, GLsizei vertex_count)
+{
+    static const ScoreTable table;
+    size_t triangle_count = indices.size() / 3;
+    indices.resize(triangle_count * 3);
+    if (triangle_count == 0)
+        return;
+
+    // Triangles adjacent to each vertex, stored contiguously per vertex
+    std::vector<unsigned> remaining(vertex_count, 0);
+    for (GLuint index : indices)
+        remaining[index]++;
+
+    std::vector<size_t> adjacency_offset(vertex_count + 1, 0);
+    for (GLsizei v = 0; v < vertex_count; v++)
+        adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+
+    std::vector<unsigned> adjacency(indices.size());
+    std::vector<size_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (unsigned)t;
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (GLsizei v = 0; v < vertex_count; v++)
+        vertex_score[v] = table.score(-1, remaining[v]);
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    for (size_t t = 0; t < triangle_count; t++)
+        triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+    std::vector<GLuint> output;
+    output.reserve(indices.size());
+
+    GLuint cache[CACHE_SIZE + 3];
+    int cache_count = 0;
+    size_t next_unemitted = 0;
+    long best = (long)(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+
+    while (output.size() < indices.size())
+    {
+        // Dead end: nothing in the cache touches a remaining triangle, restart in input order
+        if (best < 0)
+        {
+            while (emitted[next_unemitted])
+                next_unemitted++;
+            best = (long)next_unemitted;
+        }
+
+        const GLuint *triangle = &indices[best * 3];
+        emitted[best] = true;
+
+        GLuint new_cache[CACHE_SIZE + 3];
+        int new_count = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            GLuint v = triangle[k];
+            output.push_back(v);
+            if (std::find(new_cache, new_cache + new_count, v) == new_cache + new_count)
+                new_cache[new_count++] = v;
+
+            // Drop the emitted triangle from the vertex's remaining adjacency
+            unsigned *first = &adjacency[adjacency_offset[v]];
+            unsigned *last = first + remaining[v];
+            *std::find(first, last, (unsigned)best) = *(last - 1);
+            remaining[v]--;
+        }
+
+        for (int i = 0; i < cache_count; i++)
+        {
+            GLuint v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                new_cache[new_count++] = v;
+        }
+
+        // Vertices pushed past the end of the cache lose their cache score
+        for (int i = CACHE_SIZE; i < new_count; i++)
+            cache_position[new_cache[i]] = -1;
+
+        cache_count = std::min(new_count, CACHE_SIZE);
+        memcpy(cache, new_cache, new_count * sizeof(GLuint));
+
+        for (int i = 0; i < new_count; i++)
+        {
+            GLuint v = new_cache[i];
+            if (i < CACHE_SIZE)
+                cache_position[v] = i;
+
+            float score = table.score(cache_position[v], remaining[v]);
+            float delta = score - vertex_score[v];
+            vertex_score[v] = score;
+
+            for (size_t a = adjacency_offset[v]; a < adjacency_offset[v] + remaining[v]; a++)
+                triangle_score[adjacency[a]] += delta;
+        }
+
+        // The next triangle is the best one touching the cache
+        best = -1;
+        float best_score = -1.0f;
+        for (int i = 0; i < cache_count; i++)
+        {
+            GLuint v = cache[i];
+            for (size_t a = adjacency_offset[v]; a < adjacency_offset[v] + remaining[v]; a++)
+            {
+                unsigned t = adjacency[a];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = (long)t;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+MeshIndexStats index_mesh(Mesh &mesh)
+{
+    MeshIndexStats stats;
+    // A trailing partial triangle is never drawn, so it is not indexed either
+    GLsizei source_count = mesh.vertex_count / 3 * 3;
+    const GLfloat *source = mesh.data();
+
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices(source_count);
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> unique;
+    unique.reserve(source_count);
+
+    for (GLsizei i = 0; i < source_count; i++)
+    {
+        VertexKey key;
+        memcpy(key.v, source + (size_t)i * VERTEX_SIZE, sizeof(key.v));
+        for (int k = 0; k < VERTEX_SIZE; k++)
+            key.v[k] += 0.0f; // folds -0.0 into 0.0 so they weld
+
+        auto inserted = unique.emplace(key, (GLuint)unique.size());
+        if (inserted.second)
+            vertices.insert(vertices.end(), key.v, key.v + VERTEX_SIZE);
+        indices[i] = inserted.first->second;
+    }
+
+    GLsizei unique_count = (GLsizei)unique.size();
+    stats.unindexed.acmr = 3.0f;
+    stats.unindexed.atvr = unique_count ? (float)source_count / unique_count : 0;
+    stats.welded = vertex_cache_stats(indices.data(), indices.size(), unique_count, VERTEX_CACHE_SIMULATION_SIZE);
+
+    optimize_vertex_cache(indices, unique_count);
+    stats.optimized = vertex_cache_stats(indices.data(), indices.size(), unique_count, VERTEX_CACHE_SIMULATION_SIZE);
+
+    // Lay vertices out in the order the optimized index buffer first touches them
+    std::vector<GLuint> remap(unique_count, (GLuint)-1);
+    std::vector<GLfloat> ordered(vertices.size());
+    GLuint next = 0;
+    for (GLuint &index : indices)
+    {
+        if (remap[index] == (GLuint)-1)
+        {
+            memcpy(&ordered[(size_t)next * VERTEX_SIZE], &vertices[(size_t)index * VERTEX_SIZE], VERTEX_SIZE * sizeof(GLfloat));
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    GLfloat bounds_min[3], bounds_max[3];
+    memcpy(bounds_min, mesh.bounds_min, sizeof(bounds_min));
+    memcpy(bounds_max, mesh.bounds_max, sizeof(bounds_max));
+
+    mesh = Mesh();
+    mesh.vertices.swap(ordered);
+    mesh.indices.swap(indices);
+    mesh.vertex_count = unique_count;
+    mesh.index_count = (GLsizei)mesh.indices.size();
+    memcpy(mesh.bounds_min, bounds_min, sizeof(bounds_min));
+    memcpy(mesh.bounds_max, bounds_max, sizeof(bounds_max));
+    return stats;
+}
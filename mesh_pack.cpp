@@ -0,0 +1,38 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+std::vector<PackedVertex> pack_vertices(const Mesh &mesh)
+{
+    std::vector<PackedVertex> packed(mesh.vertex_count);
+    const GLfloat *source = mesh.data();
+
+    // Positions map the bounding box onto 0..65535 per axis; a flat axis stays at 0
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float extent = mesh.bounds_max[axis] - mesh.bounds_min[axis];
+        scale[axis] = extent > 0 ? 65535.0f / extent : 0.0f;
+    }
+
+    for (GLsizei v = 0; v < mesh.vertex_count; v++, source += VERTEX_SIZE)
+    {
+        PackedVertex &vertex = packed[v];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float quantized = std::round((source[axis] - mesh.bounds_min[axis]) * scale[axis]);
+            vertex.position[axis] = (GLushort)std::min(std::max(quantized, 0.0f), 65535.0f);
+        }
+        vertex.padding = 0;
+
+        for (int channel = 0; channel < 3; channel++)
+        {
+            float quantized = std::round(source[3 + channel] * 255.0f);
+            vertex.color[channel] = (GLubyte)std::min(std::max(quantized, 0.0f), 255.0f);
+        }
+        vertex.color[3] = 255;
+    }
+
+    return packed;
+}
@@ -0,0 +1,362 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+
+// Simplification works on (x, y, z, r, g, b) points: positions divided by the mesh extent,
+// colors scaled by COLOR_WEIGHT. Moving a vertex across the whole model then costs as much
+// as shifting its color by 1 / COLOR_WEIGHT.
+const int QUADRIC_DIMENSION = VERTEX_SIZE;
+const double COLOR_WEIGHT = 0.5;
+
+// Generalized quadric of Garland & Heckbert, "Simplifying Surfaces with Color and Texture
+// using Quadric Error Metrics": squared distance of a point to a set of planes in 6D,
+// error(v) = v'Av + 2b'v + c with A symmetric (upper triangle stored). Planes are weighted
+// by triangle area; dividing by the total weight gives a mean squared distance.
+struct Quadric
+{
+    double a[QUADRIC_DIMENSION * (QUADRIC_DIMENSION + 1) / 2];
+    double b[QUADRIC_DIMENSION];
+    double c;
+    double weight;
+
+    void add(const Quadric &other)
+    {
+        for (size_t i = 0; i < sizeof(a) / sizeof(a[0]); i++)
+            a[i] += other.a[i];
+        for (int i = 0; i < QUADRIC_DIMENSION; i++)
+            b[i] += other.b[i];
+        c += other.c;
+        weight += other.weight;
+    }
+
+    double error(const double *v) const
+    {
+        double result = c;
+        int k = 0;
+        for (int i = 0; i < QUADRIC_DIMENSION; i++)
+        {
+            result += a[k++] * v[i] * v[i] + 2 * b[i] * v[i];
+            for (int j = i + 1; j < QUADRIC_DIMENSION; j++)
+                result += 2 * a[k++] * v[i] * v[j];
+        }
+        return weight > 0 ? std::max(result, 0.0) / weight : 0.0;
+    }
+};
+
+double dot(const double *a, const double *b)
+{
+    double result = 0;
+    for (int i = 0; i < QUADRIC_DIMENSION; i++)
+        result += a[i] * b[i];
+    return result;
+}
+
+// Adds the quadric of the plane through p, q, r (weighted by the triangle's area)
+void add_triangle_quadric(Quadric &quadric, const double *p, const double *q, const double *r)
+{
+    double e1[QUADRIC_DIMENSION], e2[QUADRIC_DIMENSION];
+    for (int i = 0; i < QUADRIC_DIMENSION; i++)
+    {
+        e1[i] = q[i] - p[i];
+        e2[i] = r[i] - p[i];
+    }
+
+    // Area from the position part only, so color detail doesn't weigh more than shape
+    double u[3] = {e1[0], e1[1], e1[2]}, w[3] = {e2[0], e2[1], e2[2]};
+    double cross[3] = {u[1] * w[2] - u[2] * w[1], u[2] * w[0] - u[0] * w[2], u[0] * w[1] - u[1] * w[0]};
+    double area = 0.5 * std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+    // Orthonormal basis e1, e2 of the triangle's plane
+    double length = std::sqrt(dot(e1, e1));
+    if (length == 0 || area == 0)
+        return;
+    for (int i = 0; i < QUADRIC_DIMENSION; i++)
+        e1[i] /= length;
+    double along = dot(e1, e2);
+    for (int i = 0; i < QUADRIC_DIMENSION; i++)
+        e2[i] -= along * e1[i];
+    length = std::sqrt(dot(e2, e2));
+    if (length == 0)
+        return;
+    for (int i = 0; i < QUADRIC_DIMENSION; i++)
+        e2[i] /= length;
+
+    // A = I - e1e1' - e2e2', b = (p.e1)e1 + (p.e2)e2 - p, c = p.p - (p.e1)^2 - (p.e2)^2
+    double pe1 = dot(p, e1), pe2 = dot(p, e2);
+    int k = 0;
+    for (int i = 0; i < QUADRIC_DIMENSION; i++)
+    {
+        for (int j = i; j < QUADRIC_DIMENSION; j++)
+            quadric.a[k++] += area * ((i == j ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j]);
+        quadric.b[i] += area * (pe1 * e1[i] + pe2 * e2[i] - p[i]);
+    }
+    quadric.c += area * (dot(p, p) - pe1 * pe1 - pe2 * pe2);
+    quadric.weight += area;
+}
+
+struct Collapse
+{
+    GLuint from, to;
+    double cost;
+};
+
+uint64_t edge_key(GLuint a, GLuint b)
+{
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+void triangle_normal(const double *points, GLuint a, GLuint b, GLuint c, double *normal)
+{
+    const double *p = points + (size_t)a * QUADRIC_DIMENSION;
+    const double *q = points + (size_t)b * QUADRIC_DIMENSION;
+    const double *r = points + (size_t)c * QUADRIC_DIMENSION;
+    double u[3] = {q[0] - p[0], q[1] - p[1], q[2] - p[2]};
+    double w[3] = {r[0] - p[0], r[1] - p[1], r[2] - p[2]};
+    normal[0] = u[1] * w[2] - u[2] * w[1];
+    normal[1] = u[2] * w[0] - u[0] * w[2];
+    normal[2] = u[0] * w[1] - u[1] * w[0];
+}
+
+} // namespace
+
+std::vector<GLuint> simplify_mesh(const GLfloat *vertices, GLsizei vertex_count, const GLuint *indices, size_t index_count,
+                                  size_t target_index_count, float *result_error)
+{
+    std::vector<GLuint> result(indices, indices + index_count / 3 * 3);
+    if (result_error)
+        *result_error = 0;
+    if (result.size() <= target_index_count || vertex_count == 0)
+        return result;
+
+    // Normalized points, see COLOR_WEIGHT
+    float extent = 0;
+    {
+        float low[3], high[3];
+        memcpy(low, vertices, sizeof(low));
+        memcpy(high, vertices, sizeof(high));
+        for (GLsizei v = 0; v < vertex_count; v++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                low[axis] = std::min(low[axis], vertices[(size_t)v * VERTEX_SIZE + axis]);
+                high[axis] = std::max(high[axis], vertices[(size_t)v * VERTEX_SIZE + axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; axis++)
+            extent = std::max(extent, high[axis] - low[axis]);
+    }
+    double position_scale = extent > 0 ? 1.0 / extent : 1.0;
+
+    std::vector<double> points((size_t)vertex_count * QUADRIC_DIMENSION);
+    for (size_t i = 0; i < points.size(); i++)
+        points[i] = vertices[i] * (i % VERTEX_SIZE < 3 ? position_scale : COLOR_WEIGHT);
+
+    // Vertices on open borders and color seams (another vertex at the same position) never
+    // move: collapsing them could open cracks between the two sides of the seam
+    std::vector<unsigned char> locked(vertex_count, 0);
+    {
+        std::unordered_map<uint64_t, int> edge_use;
+        edge_use.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+                edge_use[edge_key(result[i + e], result[i + (e + 1) % 3])]++;
+        }
+        for (const auto &edge : edge_use)
+        {
+            if (edge.second != 2)
+            {
+                locked[edge.first >> 32] = 1;
+                locked[edge.first & 0xffffffffu] = 1;
+            }
+        }
+
+        std::unordered_map<uint64_t, GLuint> first_at;
+        first_at.reserve(vertex_count);
+        for (GLsizei v = 0; v < vertex_count; v++)
+        {
+            // Position bits hashed down to 64 bits; a false match only locks a vertex
+            uint64_t key = 14695981039346656037ull;
+            const unsigned char *bytes = (const unsigned char *)(vertices + (size_t)v * VERTEX_SIZE);
+            for (size_t i = 0; i < 3 * sizeof(GLfloat); i++)
+                key = (key ^ bytes[i]) * 1099511628211ull;
+
+            auto inserted = first_at.emplace(key, (GLuint)v);
+            if (!inserted.second)
+            {
+                locked[v] = 1;
+                locked[inserted.first->second] = 1;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        Quadric triangle;
+        memset(&triangle, 0, sizeof(triangle));
+        add_triangle_quadric(triangle, &points[(size_t)result[i] * QUADRIC_DIMENSION],
+                             &points[(size_t)result[i + 1] * QUADRIC_DIMENSION], &points[(size_t)result[i + 2] * QUADRIC_DIMENSION]);
+        for (int k = 0; k < 3; k++)
+            quadrics[result[i + k]].add(triangle);
+    }
+
+    std::vector<GLuint> remap(vertex_count);
+    std::vector<unsigned char> touched(vertex_count);
+    std::vector<GLuint> triangle_start(vertex_count + 1), vertex_triangles;
+    std::vector<Collapse> collapses;
+    double max_error = 0;
+
+    // Each pass collapses the cheapest edges that don't share a neighbourhood, so one pass
+    // can apply many collapses without re-evaluating costs in between
+    while (result.size() > target_index_count)
+    {
+        size_t triangle_count = result.size() / 3;
+
+        // Triangles around each vertex, as one flat array indexed by triangle_start
+        std::fill(triangle_start.begin(), triangle_start.end(), 0);
+        for (GLuint index : result)
+            triangle_start[index + 1]++;
+        for (GLsizei v = 0; v < vertex_count; v++)
+            triangle_start[v + 1] += triangle_start[v];
+        vertex_triangles.resize(result.size());
+        std::vector<GLuint> fill(triangle_start.begin(), triangle_start.end() - 1);
+        for (size_t t = 0; t < triangle_count; t++)
+        {
+            for (int k = 0; k < 3; k++)
+                vertex_triangles[fill[result[t * 3 + k]]++] = (GLuint)t;
+        }
+
+        // Cost of moving each unlocked vertex onto a neighbour along a triangle edge
+        collapses.clear();
+        for (size_t t = 0; t < triangle_count; t++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint from = result[t * 3 + k], to = result[t * 3 + (k + 1) % 3];
+                if (locked[from])
+                    continue;
+
+                Quadric merged = quadrics[from];
+                merged.add(quadrics[to]);
+                collapses.push_back({from, to, merged.error(&points[(size_t)to * QUADRIC_DIMENSION])});
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b)
+                  { return a.cost < b.cost; });
+
+        // A collapse removes about two triangles; stop halfway to the target to re-evaluate costs
+        size_t remaining = (result.size() - target_index_count) / 3;
+        size_t limit = std::max<size_t>(1, remaining / 2 + remaining % 2);
+        size_t applied = 0;
+        for (GLsizei v = 0; v < vertex_count; v++)
+            remap[v] = (GLuint)v;
+        std::fill(touched.begin(), touched.end(), 0);
+
+        for (const Collapse &collapse : collapses)
+        {
+            if (applied >= limit)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Reject collapses that would flip a remaining triangle around `from`
+            bool flips = false;
+            for (GLuint i = triangle_start[collapse.from]; i < triangle_start[collapse.from + 1] && !flips; i++)
+            {
+                const GLuint *triangle = &result[(size_t)vertex_triangles[i] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    continue;
+
+                GLuint moved[3];
+                for (int k = 0; k < 3; k++)
+                    moved[k] = triangle[k] == collapse.from ? collapse.to : triangle[k];
+
+                double before[3], after[3];
+                triangle_normal(points.data(), triangle[0], triangle[1], triangle[2], before);
+                triangle_normal(points.data(), moved[0], moved[1], moved[2], after);
+                flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0;
+            }
+            if (flips)
+                continue;
+
+            // Everything around `from` is off limits for the rest of this pass, which keeps the
+            // flip test above valid
+            for (GLuint i = triangle_start[collapse.from]; i < triangle_start[collapse.from + 1]; i++)
+            {
+                const GLuint *triangle = &result[(size_t)vertex_triangles[i] * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            max_error = std::max(max_error, collapse.cost);
+            applied++;
+        }
+        if (applied == 0)
+            break;
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t t = 0; t < triangle_count; t++)
+        {
+            GLuint a = remap[result[t * 3]], b = remap[result[t * 3 + 1]], c = remap[result[t * 3 + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    // Quadric errors are mean squared distances in the normalized space; report a length
+    // in units of the mesh extent
+    if (result_error)
+        *result_error = (float)std::sqrt(max_error);
+    return result;
+}
+
+int build_lods(Mesh &mesh)
+{
+    std::vector<GLuint> full(mesh.index_data(), mesh.index_data() + mesh.index_count);
+    std::vector<GLuint> all = full;
+
+    mesh.lods[0] = {0, mesh.index_count, 0.0f};
+    mesh.lod_count = 1;
+
+    // Each level simplifies the previous one, which is smaller and already close to the target
+    std::vector<GLuint> previous = full;
+    for (int level = 1; level < MESH_MAX_LODS; level++)
+    {
+        size_t target = (size_t)(full.size() / 3 * LOD_TRIANGLE_RATIOS[level]) * 3;
+        float error;
+        std::vector<GLuint> lod = simplify_mesh(mesh.data(), mesh.vertex_count, previous.data(), previous.size(), target, &error);
+
+        // Stop once the simplifier can't get meaningfully below the previous level
+        if (lod.empty() || lod.size() * 10 > previous.size() * 9)
+            break;
+
+        // Errors of successive levels add up at worst
+        optimize_vertex_cache(lod, mesh.vertex_count);
+        error += mesh.lods[level - 1].error;
+        mesh.lods[level] = {(GLuint)all.size(), (GLsizei)lod.size(), error};
+        mesh.lod_count = level + 1;
+        all.insert(all.end(), lod.begin(), lod.end());
+        previous.swap(lod);
+    }
+
+    mesh.indices.swap(all);
+    mesh.index_count = (GLsizei)mesh.indices.size();
+    return mesh.lod_count;
+}
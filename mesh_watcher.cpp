@@ -0,0 +1,130 @@
+#include "mesh_watcher.h"
+
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// How long the watcher thread sleeps in poll() before checking whether it should stop
+static const int WATCH_POLL_MS = 100;
+
+// Writes arriving this soon after a change are folded into the same reload
+static const int WATCH_SETTLE_MS = 20;
+
+MeshWatcher::~MeshWatcher()
+{
+    stop();
+}
+
+bool MeshWatcher::start(const std::vector<std::string> &files, std::function<void()> callback)
+{
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0)
+    {
+        std::cout << "File watching unavailable (inotify_init1 failed)" << std::endl;
+        return false;
+    }
+
+    filenames = files;
+    notify = callback;
+    for (const std::string &filename : filenames)
+    {
+        size_t slash = filename.find_last_of('/');
+        std::string directory = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+        base_names.push_back(slash == std::string::npos ? filename : filename.substr(slash + 1));
+
+        // Watching a directory twice returns the same descriptor
+        int watch = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watch < 0)
+            std::cout << "Cannot watch " << directory << " for changes" << std::endl;
+        directory_watches.push_back(watch);
+    }
+
+    running = true;
+    thread = std::thread(&MeshWatcher::run, this);
+    return true;
+}
+
+void MeshWatcher::stop()
+{
+    if (thread.joinable())
+    {
+        running = false;
+        thread.join();
+    }
+    if (inotify_fd >= 0)
+    {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+}
+
+void MeshWatcher::run()
+{
+    alignas(inotify_event) char buffer[4096];
+    std::vector<bool> changed(filenames.size());
+    pollfd descriptor = {inotify_fd, POLLIN, 0};
+
+    while (running)
+    {
+        if (::poll(&descriptor, 1, WATCH_POLL_MS) <= 0)
+            continue;
+
+        // Collect events until the writer has been quiet for a moment, so a save that
+        // touches the file several times is parsed once
+        bool any = false;
+        std::chrono::steady_clock::time_point noticed = std::chrono::steady_clock::now();
+        do
+        {
+            ssize_t length;
+            while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *cursor = buffer; cursor < buffer + length;)
+                {
+                    const inotify_event *event = (const inotify_event *)cursor;
+                    cursor += sizeof(inotify_event) + event->len;
+                    if (event->len == 0)
+                        continue;
+
+                    for (size_t i = 0; i < filenames.size(); i++)
+                    {
+                        if (directory_watches[i] == event->wd && base_names[i] == event->name)
+                        {
+                            changed[i] = true;
+                            any = true;
+                        }
+                    }
+                }
+            }
+        } while (::poll(&descriptor, 1, WATCH_SETTLE_MS) > 0);
+
+        for (size_t i = 0; i < filenames.size() && any; i++)
+        {
+            if (!changed[i])
+                continue;
+            changed[i] = false;
+
+            ReloadedMesh reloaded;
+            reloaded.index = i;
+            reloaded.changed = noticed;
+            auto parse_start = std::chrono::steady_clock::now();
+            reloaded.mesh = load_mesh(filenames[i]);
+            reloaded.parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(std::move(reloaded));
+            }
+            if (notify)
+                notify();
+        }
+    }
+}
+
+void MeshWatcher::poll(std::vector<ReloadedMesh> &ready)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (ReloadedMesh &reloaded : finished)
+        ready.push_back(std::move(reloaded));
+    finished.clear();
+}
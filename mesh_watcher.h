@@ -0,0 +1,56 @@
+#ifndef MESH_WATCHER_H
+#define MESH_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mesh.h"
+
+// A vertex file parsed again after it changed on disk
+struct ReloadedMesh
+{
+    size_t index; // position in the list given to start()
+    Mesh mesh;
+    std::chrono::steady_clock::time_point changed; // when the change was noticed
+    double parse_ms;
+};
+
+// Watches vertex files with inotify and re-runs load_mesh() on its own thread whenever one
+// is rewritten, so the render loop only has to upload the result. The directories are
+// watched rather than the files, which also catches editors that save by renaming a
+// temporary file over the original.
+struct MeshWatcher
+{
+    MeshWatcher() = default;
+    MeshWatcher(const MeshWatcher &) = delete;
+    MeshWatcher &operator=(const MeshWatcher &) = delete;
+    ~MeshWatcher();
+
+    // Starts watching; notify is called from the watcher thread after each reload (to wake
+    // up a render loop sleeping on events). Returns false if inotify is unavailable.
+    bool start(const std::vector<std::string> &filenames, std::function<void()> notify);
+    void stop();
+
+    // Moves every reload finished since the last call into ready without blocking
+    void poll(std::vector<ReloadedMesh> &ready);
+
+private:
+    std::vector<std::string> filenames;
+    std::function<void()> notify;
+    int inotify_fd = -1;
+    std::vector<int> directory_watches;  // per file, watch descriptor of its directory
+    std::vector<std::string> base_names; // per file, name within that directory
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::mutex mutex;
+    std::vector<ReloadedMesh> finished;
+
+    void run();
+};
+
+#endif
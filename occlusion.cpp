@@ -0,0 +1,152 @@
+#include "occlusion.h"
+
+#include <iostream>
+
+#include "program_cache.h"
+
+// Unit cube stretched over the box in the vertex shader; only depth matters
+static const GLchar *BOX_VERTEX_SHADER = "#version 330 core\n"
+                                         "uniform mat4 mvp;\n"
+                                         "uniform vec3 box_min;\n"
+                                         "uniform vec3 box_max;\n"
+                                         "in vec3 corner;\n"
+                                         "void main()\n"
+                                         "{\n"
+                                         "gl_Position = mvp * vec4(mix(box_min, box_max, corner), 1.0);\n"
+                                         "}\0";
+
+static const GLchar *BOX_FRAGMENT_SHADER = "#version 330 core\n"
+                                           "out vec4 color_out;\n"
+                                           "void main()\n"
+                                           "{\n"
+                                           "color_out = vec4(1.0);\n"
+                                           "}\n\0";
+
+static const GLfloat CUBE_CORNERS[8][3] = {
+    {0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1},
+};
+
+// Both windings of every face are fine: face culling is off
+static const GLubyte CUBE_INDICES[36] = {
+    0, 1, 2, 0, 2, 3, // z = 0
+    4, 6, 5, 4, 7, 6, // z = 1
+    0, 4, 5, 0, 5, 1, // y = 0
+    3, 2, 6, 3, 6, 7, // y = 1
+    0, 3, 7, 0, 7, 4, // x = 0
+    1, 5, 6, 1, 6, 2, // x = 1
+};
+
+bool OcclusionCuller::init(size_t instance_count, const std::string &cache_dir)
+{
+    program = load_program(BOX_VERTEX_SHADER, BOX_FRAGMENT_SHADER, cache_dir);
+    if (!program)
+        return false;
+    mvp_location = glGetUniformLocation(program, "mvp");
+    box_min_location = glGetUniformLocation(program, "box_min");
+    box_max_location = glGetUniformLocation(program, "box_max");
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_CORNERS), CUBE_CORNERS, GL_STATIC_DRAW);
+    GLint corner_location = glGetAttribLocation(program, "corner");
+    glVertexAttribPointer(corner_location, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
+    glEnableVertexAttribArray(corner_location);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    queries.resize(instance_count);
+    glGenQueries((GLsizei)queries.size(), queries.data());
+    flags.assign(instance_count, 0);
+    return true;
+}
+
+void OcclusionCuller::destroy()
+{
+    glDeleteQueries((GLsizei)queries.size(), queries.data());
+    queries.clear();
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteProgram(program);
+}
+
+void OcclusionCuller::collect()
+{
+    frames++;
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+        if (!(flags[i] & PENDING))
+            continue;
+
+        // Never wait: by now the GPU has normally finished the previous frame
+        GLuint available = 0, any_samples = 1;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &any_samples);
+        }
+        else
+        {
+            unavailable++;
+        }
+        flags[i] = any_samples ? 0 : HIDDEN;
+        if (!any_samples)
+            hidden++;
+    }
+}
+
+void OcclusionCuller::query(const std::vector<uint32_t> &instances, const std::vector<Aabb> &bounds, mat4x4 mvp)
+{
+    glUseProgram(program);
+    glBindVertexArray(VAO);
+    glUniformMatrix4fv(mvp_location, 1, GL_FALSE, (GLfloat *)mvp);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    // A box whose faces coincide with the instance's own surface (a cube) still passes, and
+    // one cut by the near plane is clamped to it instead of losing its front faces
+    glDepthFunc(GL_LEQUAL);
+    glEnable(GL_DEPTH_CLAMP);
+
+    for (uint32_t instance : instances)
+    {
+        const Aabb &box = bounds[instance];
+        glUniform3fv(box_min_location, 1, box.min);
+        glUniform3fv(box_max_location, 1, box.max);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[instance]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        flags[instance] |= PENDING;
+    }
+    tested += (long)instances.size();
+
+    glDisable(GL_DEPTH_CLAMP);
+    glDepthFunc(GL_LESS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+}
+
+void OcclusionCuller::begin_conditional(uint32_t instance) const
+{
+    // The GPU waits for the query it just issued; the CPU never does
+    glBeginConditionalRender(queries[instance], GL_QUERY_WAIT);
+}
+
+void OcclusionCuller::end_conditional() const
+{
+    glEndConditionalRender();
+}
+
+void OcclusionCuller::print_stats() const
+{
+    if (frames == 0)
+        return;
+
+    std::cout << "Occlusion culling: " << (double)tested / frames << " boxes queried, "
+              << (double)hidden / frames << " instances hidden per frame on average ("
+              << unavailable << " results not ready in time)" << std::endl;
+}
@@ -0,0 +1,70 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Linmath
+#include "deps/linmath.h"
+
+#include "bvh.h"
+
+// Occlusion culling of instances with GL_ANY_SAMPLES_PASSED queries on their bounding boxes.
+// Each frame:
+//
+//   1. collect() reads back the previous frame's results; instances whose box had no
+//      visible sample are flagged hidden
+//   2. the caller draws the instances that are not hidden as usual
+//   3. query() rasterizes the box of every candidate (color and depth writes off) against
+//      the depth those draws left, one query per instance
+//   4. the caller draws each hidden instance inside begin_conditional()/end_conditional(),
+//      so the GPU skips it unless its box passed in step 3
+//
+// A hidden instance that comes back into view is drawn in the same frame, because its
+// box is tested against geometry that is actually on screen. Culling can therefore never
+// remove anything visible, so nothing pops. Results not yet available when collected count
+// as visible.
+struct OcclusionCuller
+{
+    // Counters, see print_stats()
+    long frames = 0;
+    long tested = 0;      // box queries issued
+    long hidden = 0;      // collected results with no visible sample
+    long unavailable = 0; // results not ready when collected, treated as visible
+
+    // Creates the box program (cached like the main one in cache_dir), the unit cube and
+    // one query per instance. Returns false if the program can't be built.
+    bool init(size_t instance_count, const std::string &cache_dir);
+    void destroy();
+
+    void collect();
+    bool is_hidden(uint32_t instance) const { return flags[instance] & HIDDEN; }
+
+    // Queries the boxes (bounds, indexed by instance) of instances under mvp. Leaves the box
+    // program and vertex array bound, color and depth writes back on and the depth test at GL_LESS.
+    void query(const std::vector<uint32_t> &instances, const std::vector<Aabb> &bounds, mat4x4 mvp);
+
+    void begin_conditional(uint32_t instance) const;
+    void end_conditional() const;
+
+    void print_stats() const;
+
+private:
+    enum
+    {
+        HIDDEN = 1,
+        PENDING = 2, // queried, result not collected yet
+    };
+
+    std::vector<GLuint> queries;
+    std::vector<unsigned char> flags;
+    GLuint program = 0, VAO = 0, VBO = 0, EBO = 0;
+    GLint mvp_location = -1, box_min_location = -1, box_max_location = -1;
+};
+
+#endif
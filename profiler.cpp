@@ -0,0 +1,232 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {
+    "poll_events",
+    "build_matrices",
+    "cull",
+    "upload_uniforms",
+    "draw",
+    "swap_buffers",
+};
+
+void FrameProfiler::init()
+{
+    if (!enabled)
+        return;
+
+    origin = std::chrono::steady_clock::now();
+    glGenQueries(QUERY_COUNT, queries);
+    for (int i = 0; i < QUERY_COUNT; i++)
+        query_frame[i] = -1;
+}
+
+void FrameProfiler::destroy()
+{
+    if (!enabled)
+        return;
+
+    glDeleteQueries(QUERY_COUNT, queries);
+}
+
+double FrameProfiler::now_us() const
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void FrameProfiler::begin_frame()
+{
+    if (!enabled)
+        return;
+
+    collect_queries();
+
+    FrameRecord record;
+    record.start_us = now_us();
+    record.cpu_us = 0;
+    record.gpu_us = -1;
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        record.stage_start_us[stage] = record.start_us;
+        record.stage_us[stage] = 0;
+    }
+    frames.push_back(record);
+}
+
+void FrameProfiler::end_frame()
+{
+    if (!enabled || frames.empty())
+        return;
+
+    frames.back().cpu_us = now_us() - frames.back().start_us;
+}
+
+void FrameProfiler::begin_stage(ProfileStage stage)
+{
+    if (!enabled || frames.empty())
+        return;
+
+    frames.back().stage_start_us[stage] = now_us();
+}
+
+void FrameProfiler::end_stage(ProfileStage stage)
+{
+    if (!enabled || frames.empty())
+        return;
+
+    FrameRecord &record = frames.back();
+    record.stage_us[stage] += now_us() - record.stage_start_us[stage];
+}
+
+void FrameProfiler::begin_gpu()
+{
+    if (!enabled || frames.empty() || query_frame[query_next] >= 0)
+        return;
+
+    glBeginQuery(GL_TIME_ELAPSED, queries[query_next]);
+    gpu_active = true;
+}
+
+void FrameProfiler::end_gpu()
+{
+    if (!gpu_active)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+    query_frame[query_next] = (long)frames.size() - 1;
+    query_next = (query_next + 1) % QUERY_COUNT;
+    gpu_active = false;
+}
+
+void FrameProfiler::collect_queries()
+{
+    // Queries finish in submission order, so stop at the first one still pending
+    for (int i = 0; i < QUERY_COUNT; i++)
+    {
+        int slot = (query_next + i) % QUERY_COUNT;
+        if (query_frame[slot] < 0)
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+
+        GLuint64 elapsed_ns = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed_ns);
+        frames[query_frame[slot]].gpu_us = elapsed_ns / 1000.0;
+        query_frame[slot] = -1;
+    }
+}
+
+bool FrameProfiler::write(const std::string &filename)
+{
+    if (!enabled)
+        return true;
+
+    collect_queries();
+
+    FILE *out = fopen(filename.c_str(), "w");
+    if (!out)
+    {
+        std::cout << "Cannot write trace " << filename << std::endl;
+        return false;
+    }
+
+    bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+    if (csv)
+    {
+        fprintf(out, "frame");
+        for (int stage = 0; stage < STAGE_COUNT; stage++)
+            fprintf(out, ",%s_us", STAGE_NAMES[stage]);
+        fprintf(out, ",cpu_frame_us,gpu_us\n");
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            fprintf(out, "%zu", i);
+            for (int stage = 0; stage < STAGE_COUNT; stage++)
+                fprintf(out, ",%.3f", frames[i].stage_us[stage]);
+            fprintf(out, ",%.3f,%.3f\n", frames[i].cpu_us, frames[i].gpu_us);
+        }
+    }
+    else
+    {
+        // Chrome trace event format: complete ("X") events, CPU stages on thread 1, GPU on thread 2.
+        // GL_TIME_ELAPSED only gives a duration, so GPU spans are placed at the frame's draw start.
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+        fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            const FrameRecord &record = frames[i];
+            fprintf(out, ",\n{\"name\":\"frame\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"frame\":%zu}}",
+                    record.start_us, record.cpu_us, i);
+
+            for (int stage = 0; stage < STAGE_COUNT; stage++)
+            {
+                if (record.stage_us[stage] > 0)
+                    fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                            STAGE_NAMES[stage], record.stage_start_us[stage], record.stage_us[stage]);
+            }
+
+            if (record.gpu_us >= 0)
+                fprintf(out, ",\n{\"name\":\"gpu_frame\",\"cat\":\"gpu\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":2,\"args\":{\"frame\":%zu}}",
+                        record.stage_start_us[STAGE_BUILD_MATRICES], record.gpu_us, i);
+        }
+        fprintf(out, "\n]}\n");
+    }
+
+    bool ok = fclose(out) == 0;
+    std::cout << "Wrote " << frames.size() << " frame records to " << filename << std::endl;
+    return ok;
+}
+
+static double median(std::vector<double> &values)
+{
+    if (values.empty())
+        return 0;
+
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+void FrameProfiler::print_summary()
+{
+    if (!enabled || frames.empty())
+        return;
+
+    // Medians rather than means: the first frames include shader JIT and driver warm-up
+    std::vector<double> values;
+    values.reserve(frames.size());
+
+    std::cout << "Median per frame over " << frames.size() << " frames (us):";
+    for (int stage = 0; stage < STAGE_COUNT; stage++)
+    {
+        values.clear();
+        for (const FrameRecord &record : frames)
+            values.push_back(record.stage_us[stage]);
+        std::cout << " " << STAGE_NAMES[stage] << " " << median(values);
+    }
+
+    values.clear();
+    for (const FrameRecord &record : frames)
+        values.push_back(record.cpu_us);
+    std::cout << ", cpu_frame " << median(values);
+
+    values.clear();
+    for (const FrameRecord &record : frames)
+    {
+        if (record.gpu_us >= 0)
+            values.push_back(record.gpu_us);
+    }
+    if (!values.empty())
+    {
+        size_t samples = values.size();
+        std::cout << ", gpu " << median(values) << " (" << samples << " samples)";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,88 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Parts of a frame timed on the CPU
+enum ProfileStage
+{
+    STAGE_POLL_EVENTS,
+    STAGE_BUILD_MATRICES,
+    STAGE_CULL,
+    STAGE_UPLOAD_UNIFORMS,
+    STAGE_DRAW,
+    STAGE_SWAP_BUFFERS,
+    STAGE_COUNT
+};
+
+struct FrameRecord
+{
+    double start_us;
+    double stage_start_us[STAGE_COUNT];
+    double stage_us[STAGE_COUNT];
+    double cpu_us;
+    double gpu_us; // negative until (or unless) the timer query result arrives
+};
+
+// Per-frame CPU stage timers plus a GL_TIME_ELAPSED query around each frame's GL work.
+// Query results are collected a few frames later, only once GL reports them available,
+// so profiling never stalls the pipeline. Disabled profilers cost one branch per call.
+struct FrameProfiler
+{
+    bool enabled = false;
+    std::vector<FrameRecord> frames;
+
+    // Creates the GL queries; needs a current context
+    void init();
+    void destroy();
+
+    void begin_frame();
+    void end_frame();
+    void begin_stage(ProfileStage stage);
+    void end_stage(ProfileStage stage);
+
+    // Brackets the GL commands measured on the GPU. Skipped when every query is still in flight.
+    void begin_gpu();
+    void end_gpu();
+
+    // Writes CSV when filename ends in ".csv", Chrome trace JSON (chrome://tracing, Perfetto) otherwise
+    bool write(const std::string &filename);
+    void print_summary();
+
+private:
+    static const int QUERY_COUNT = 4;
+
+    std::chrono::steady_clock::time_point origin;
+    GLuint queries[QUERY_COUNT] = {0};
+    long query_frame[QUERY_COUNT];
+    int query_next = 0;
+    bool gpu_active = false;
+
+    double now_us() const;
+    void collect_queries();
+};
+
+// Times a stage for the rest of the enclosing scope
+struct ProfileScope
+{
+    FrameProfiler &profiler;
+    ProfileStage stage;
+
+    ProfileScope(FrameProfiler &profiler, ProfileStage stage) : profiler(profiler), stage(stage)
+    {
+        profiler.begin_stage(stage);
+    }
+
+    ~ProfileScope()
+    {
+        profiler.end_stage(stage);
+    }
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "program_cache.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+// Layout of a program cache file:
+//   ProgramCacheHeader | binary_length bytes from glGetProgramBinary
+// The key is also part of the file name, so every shader variant and driver gets its own file.
+static const char PROGRAM_CACHE_MAGIC[4] = {'W', 'W', 'A', 'P'};
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binary_format;
+    uint32_t binary_length;
+};
+
+// FNV-1a, continued over each string including its terminator so "ab" + "c" != "a" + "bc"
+static uint64_t hash_string(uint64_t hash, const char *text)
+{
+    if (!text)
+        text = "";
+
+    do
+    {
+        hash ^= (unsigned char)*text;
+        hash *= 1099511628211ull;
+    } while (*text++);
+
+    return hash;
+}
+
+static uint64_t program_key(const GLchar *vertexSource, const GLchar *fragmentSource)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = hash_string(hash, vertexSource);
+    hash = hash_string(hash, fragmentSource);
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+    return hash;
+}
+
+static std::string program_cache_path(const std::string &cache_dir, uint64_t key)
+{
+    std::ostringstream path;
+    path << (cache_dir.empty() ? "." : cache_dir) << "/program-" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return path.str();
+}
+
+static bool link_succeeded(GLuint program, bool report)
+{
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success && report)
+    {
+        GLchar infoLog[512];
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cout << "Shader program linking failed\n"
+                  << infoLog << std::endl;
+    }
+
+    return success;
+}
+
+static GLuint read_program_cache(const std::string &path, uint64_t key)
+{
+    FILE *in = fopen(path.c_str(), "rb");
+    if (!in)
+        return 0;
+
+    ProgramCacheHeader header;
+    std::vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, in) == 1 &&
+                 memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == PROGRAM_CACHE_VERSION && header.key == key && header.binary_length > 0;
+    if (valid)
+    {
+        binary.resize(header.binary_length);
+        valid = fread(binary.data(), binary.size(), 1, in) == 1;
+    }
+    fclose(in);
+
+    if (!valid)
+        return 0;
+
+    // The driver may still reject the binary (e.g. after an update that kept the version string)
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binary_format, binary.data(), header.binary_length);
+    if (!link_succeeded(program, false))
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static bool write_program_cache(const std::string &path, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+
+    ProgramCacheHeader header;
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    header.binary_format = format;
+    header.binary_length = (uint32_t)length;
+
+    // Write next to the final name and rename, so another instance never reads a partial file
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    FILE *out = fopen(temp_path.c_str(), "wb");
+    if (!out)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              fwrite(binary.data(), header.binary_length, 1, out) == 1;
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        remove(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+GLuint compile_shader(const GLchar *shaderSource, GLenum type)
+{
+    // Compile shader
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &shaderSource, NULL);
+    glCompileShader(shader);
+
+    // Check for compile time errors
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "Shader compilation failed\n"
+                  << infoLog << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+GLuint load_program(const GLchar *vertexSource, const GLchar *fragmentSource, const std::string &cache_dir)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Program binaries need GL 4.1 or ARB_get_program_binary, and a driver exposing at least one format
+    GLint format_count = 0;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+
+    uint64_t key = 0;
+    std::string path;
+    if (format_count > 0)
+    {
+        key = program_key(vertexSource, fragmentSource);
+        path = program_cache_path(cache_dir, key);
+
+        GLuint program = read_program_cache(path, key);
+        if (program)
+        {
+            std::cout << "Shader program loaded from " << path << " in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+                      << " ms" << std::endl;
+            return program;
+        }
+    }
+
+    GLuint vertexShader = compile_shader(vertexSource, GL_VERTEX_SHADER);
+    GLuint fragmentShader = compile_shader(fragmentSource, GL_FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader)
+    {
+        glDeleteShader(vertexShader);
+        glDeleteShader(fragmentShader);
+        return 0;
+    }
+
+    // Link shaders
+    GLuint program = glCreateProgram();
+    if (format_count > 0)
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+
+    // The linked program keeps its own copy; the shader objects are no longer needed
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    if (!link_succeeded(program, true))
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    std::cout << "Shader program compiled in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms" << std::endl;
+
+    if (format_count > 0 && !write_program_cache(path, key, program))
+        std::cout << "Cannot write program cache " << path << std::endl;
+
+    return program;
+}
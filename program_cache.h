@@ -0,0 +1,18 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+#include <string>
+
+// Compiles one shader stage; prints the info log and returns 0 on failure
+GLuint compile_shader(const GLchar *shaderSource, GLenum type);
+
+// Builds a vertex + fragment program. A binary saved by an earlier run in cache_dir is
+// loaded with glProgramBinary when it was built from the same source by the same
+// GL vendor, renderer and version; otherwise the program is compiled and linked from
+// source and its binary saved for the next run. Returns 0 if compiling or linking fails.
+GLuint load_program(const GLchar *vertexSource, const GLchar *fragmentSource, const std::string &cache_dir);
+
+#endif
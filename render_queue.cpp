@@ -0,0 +1,161 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <iostream>
+
+static const int KEY_DEPTH_BITS = 24;
+static const int KEY_SEQUENCE_BITS = 7;
+
+// Smaller queues are sorted with std::sort: below about this size its comparisons cost less
+// than the radix sort's fixed histogram and scatter passes (see make bench)
+static const size_t RADIX_SORT_MIN_DRAWS = 1024;
+
+uint64_t render_key(bool transparent, uint32_t program, uint32_t vertex_array, uint32_t sub_state, float depth,
+                    uint32_t sequence)
+{
+    const uint32_t depth_max = (1u << KEY_DEPTH_BITS) - 1;
+    uint64_t quantized = (uint64_t)(std::min(std::max(depth, 0.0f), 1.0f) * depth_max);
+    uint64_t state = (uint64_t)(program & 0xff) << 24 | (uint64_t)(vertex_array & 0xffff) << 8 | (sub_state & 0xff);
+    uint64_t key = sequence & ((1u << KEY_SEQUENCE_BITS) - 1);
+    if (transparent)
+        key |= 1ull << 63 | (depth_max - quantized) << 39 | state << KEY_SEQUENCE_BITS;
+    else
+        key |= state << (KEY_DEPTH_BITS + KEY_SEQUENCE_BITS) | quantized << KEY_SEQUENCE_BITS;
+    return key;
+}
+
+void RenderQueue::clear()
+{
+    items.clear();
+    order.clear();
+}
+
+void RenderQueue::push(uint64_t key, const RenderItem &item)
+{
+    order.push_back({key, (uint32_t)items.size()});
+    items.push_back(item);
+}
+
+void RenderQueue::sort()
+{
+    if (order.size() < RADIX_SORT_MIN_DRAWS)
+    {
+        std::sort(order.begin(), order.end(), [](const Entry &a, const Entry &b) { return a.key < b.key; });
+        return;
+    }
+    scratch.resize(order.size());
+
+    // One read pass counts every byte of every key. Bytes where all keys agree would only
+    // copy the array, so their passes are skipped.
+    uint32_t counts[8][256] = {};
+    for (const Entry &entry : order)
+    {
+        for (int byte = 0; byte < 8; byte++)
+            counts[byte][(entry.key >> (byte * 8)) & 0xff]++;
+    }
+
+    for (int byte = 0; byte < 8; byte++)
+    {
+        uint32_t *offsets = counts[byte];
+        if (offsets[(order[0].key >> (byte * 8)) & 0xff] == order.size())
+            continue;
+
+        // Counting sort on this byte; stable, so lower bytes keep their order within a bucket
+        uint32_t total = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            uint32_t count = offsets[digit];
+            offsets[digit] = total;
+            total += count;
+        }
+        int shift = byte * 8;
+        for (const Entry &entry : order)
+            scratch[offsets[(entry.key >> shift) & 0xff]++] = entry;
+        order.swap(scratch);
+    }
+}
+
+void RenderState::invalidate()
+{
+    program_known = vertex_array_known = transparent_known = model_known = false;
+}
+
+void RenderState::begin_frame()
+{
+    model_known = false;
+}
+
+void RenderState::end_frame(size_t item_count)
+{
+    frames++;
+    items += (long)item_count;
+}
+
+void RenderState::use_program(GLuint requested)
+{
+    program_requests++;
+    if (program_known && program == requested)
+        return;
+    glUseProgram(requested);
+    program = requested;
+    program_known = true;
+    model_known = false; // uniforms belong to the program
+    program_binds++;
+}
+
+void RenderState::bind_vertex_array(GLuint requested)
+{
+    vertex_array_requests++;
+    if (vertex_array_known && vertex_array == requested)
+        return;
+    glBindVertexArray(requested);
+    vertex_array = requested;
+    vertex_array_known = true;
+    vertex_array_binds++;
+}
+
+void RenderState::set_transparent(bool requested)
+{
+    blend_requests++;
+    if (transparent_known && transparent == requested)
+        return;
+    if (requested)
+    {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+    }
+    else
+    {
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+    }
+    transparent = requested;
+    transparent_known = true;
+    blend_changes++;
+}
+
+bool RenderState::change_model(uint32_t requested)
+{
+    uniform_requests++;
+    if (model_known && model == requested)
+        return false;
+    model = requested;
+    model_known = true;
+    uniform_updates++;
+    return true;
+}
+
+void RenderState::print_stats() const
+{
+    if (frames == 0)
+        return;
+
+    double per_frame = 1.0 / frames;
+    std::cout << "Render queue: " << items * per_frame << " draws per frame; issued of requested per frame: "
+              << program_binds * per_frame << " of " << program_requests * per_frame << " program binds, "
+              << vertex_array_binds * per_frame << " of " << vertex_array_requests * per_frame << " vertex array binds, "
+              << blend_changes * per_frame << " of " << blend_requests * per_frame << " blend changes, "
+              << uniform_updates * per_frame << " of " << uniform_requests * per_frame << " model uniform uploads"
+              << std::endl;
+}
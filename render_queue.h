@@ -0,0 +1,103 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// 64-bit sort key of a draw. Opaque draws come first, grouped by program, then vertex array,
+// then a caller-defined sub-state (e.g. which instance range the draw reads), and front to
+// back within a group so early depth testing rejects as much as possible. Transparent draws
+// follow strictly back to front, state grouping only breaking ties:
+//
+//   opaque       0 | program:8 | vertex array:16 | sub-state:8 | depth:24 | sequence:7
+//   transparent  1 | far-to-near depth:24 | program:8 | vertex array:16 | sub-state:8 | sequence:7
+//
+// program and vertex_array are small ids the caller assigns (not GL names), depth is the
+// draw's normalized depth in [0, 1] (0 nearest) and sequence orders otherwise equal draws.
+uint64_t render_key(bool transparent, uint32_t program, uint32_t vertex_array, uint32_t sub_state, float depth,
+                    uint32_t sequence = 0);
+
+// One draw of the queue: the GL objects it needs and the element range it draws. `model`
+// identifies the per-draw uniforms, so consecutive draws of the same model skip re-uploading
+// them; `mesh` and `instance_offset` say which vertex data and instance range it reads.
+struct RenderItem
+{
+    GLuint program;
+    GLuint vertex_array;
+    bool transparent;
+    uint32_t model;
+    uint32_t mesh;
+    GLintptr instance_offset;
+    GLsizei index_count;
+    GLuint first_index;
+    GLsizei instance_count;
+};
+
+// Draws collected for a frame, then ordered by key with an LSD radix sort (8 passes of
+// 8 bits, skipping bytes every key shares), which is linear in the number of draws.
+// Queues of less than a thousand or so draws are cheaper to sort with std::sort.
+struct RenderQueue
+{
+    std::vector<RenderItem> items;
+
+    void clear();
+    void push(uint64_t key, const RenderItem &item);
+    void sort();
+
+    size_t size() const { return items.size(); }
+    // i-th item in key order, valid after sort()
+    const RenderItem &sorted(size_t i) const { return items[order[i].item]; }
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t item;
+    };
+    std::vector<Entry> order, scratch;
+};
+
+// Redundant-state filter: remembers what it last bound and only calls GL when a request
+// differs. Anything else that binds a program or vertex array, or changes blending or
+// depth writes, has to call invalidate() so the next request goes through.
+struct RenderState
+{
+    // Requested and issued state changes, summed over frames (see print_stats())
+    long frames = 0;
+    long items = 0;
+    long program_requests = 0, program_binds = 0;
+    long vertex_array_requests = 0, vertex_array_binds = 0;
+    long blend_requests = 0, blend_changes = 0;
+    long uniform_requests = 0, uniform_updates = 0;
+
+    void invalidate();
+    // Per-draw uniforms change from frame to frame, so each frame uploads them afresh.
+    // end_frame counts a frame of item_count draws for the per-frame averages.
+    void begin_frame();
+    void end_frame(size_t item_count);
+
+    void use_program(GLuint program);
+    void bind_vertex_array(GLuint vertex_array);
+    // Blending on with depth writes off for transparent draws, the opposite for opaque ones
+    void set_transparent(bool transparent);
+
+    // Returns true when the caller has to upload the per-draw uniforms of model, which are
+    // then remembered as current for the rest of the frame (unless the program changes)
+    bool change_model(uint32_t model);
+
+    void print_stats() const;
+
+private:
+    GLuint program = 0, vertex_array = 0;
+    bool transparent = false;
+    uint32_t model = 0;
+    bool program_known = false, vertex_array_known = false, transparent_known = false;
+    bool model_known = false;
+};
+
+#endif
@@ -1 +1 @@
-./dist/main ./vertices/airplane.txt 96
\ No newline at end of file
+./dist/main ./vertices/airplane.txt
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "scene_graph.h"
+
+#include <cstring>
+
+int SceneGraph::add_node(int parent_node)
+{
+    int node = (int)parent.size();
+    if (parent_node >= node)
+        parent_node = -1;
+
+    parent.push_back(parent_node);
+    local.emplace_back();
+    world.emplace_back();
+    mat4x4_identity(local[node].matrix);
+    mat4x4_identity(world[node].matrix);
+    dirty.push_back(1);
+    dirty_count++;
+    return node;
+}
+
+void SceneGraph::set_local(int node, mat4x4 matrix)
+{
+    mat4x4_dup(local[node].matrix, matrix);
+    if (!dirty[node])
+    {
+        dirty[node] = 1;
+        dirty_count++;
+    }
+}
+
+size_t SceneGraph::update()
+{
+    if (dirty_count == 0)
+        return 0;
+
+    // Depth order guarantees the parent's flag is final when its child is reached, so the
+    // flags spread down a subtree within this single pass. Raw pointers keep the byte writes
+    // to the flags from forcing the vectors to be reloaded every iteration.
+    const int *parents = parent.data();
+    unsigned char *flags = dirty.data();
+    NodeMatrix *locals = local.data();
+    NodeMatrix *worlds = world.data();
+
+    size_t updated = 0;
+    size_t count = parent.size();
+    for (size_t node = 0; node < count; node++)
+    {
+        int node_parent = parents[node];
+        if (node_parent >= 0 && flags[node_parent])
+            flags[node] = 1;
+        else if (!flags[node])
+            continue;
+
+        if (node_parent >= 0)
+            mat4x4_mul(worlds[node].matrix, worlds[node_parent].matrix, locals[node].matrix);
+        else
+            mat4x4_dup(worlds[node].matrix, locals[node].matrix);
+        updated++;
+    }
+
+    memset(dirty.data(), 0, dirty.size());
+    dirty_count = 0;
+    return updated;
+}
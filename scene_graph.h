@@ -0,0 +1,47 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <cstddef>
+#include <vector>
+
+// Linmath
+#include "deps/linmath.h"
+
+// Wrapper so matrices can live in std::vector
+struct NodeMatrix
+{
+    mat4x4 matrix;
+};
+
+// Transform hierarchy (fuselage -> propeller, gear, turret ...) kept in flat arrays.
+// Nodes are stored depth-ordered: a parent always comes before its children, so one
+// front-to-back pass sees every parent's world matrix settled before its children need it.
+// Changing a local transform only flags the node; update() recomputes the flagged nodes
+// and everything below them and leaves the rest of the tree untouched.
+struct SceneGraph
+{
+    std::vector<int> parent; // -1 for roots
+    std::vector<NodeMatrix> local;
+    std::vector<NodeMatrix> world;
+    std::vector<unsigned char> dirty;
+
+    size_t size() const
+    {
+        return parent.size();
+    }
+
+    // Appends a node with an identity local transform under parent_node (-1 for a root).
+    // The parent must already exist, which keeps the array depth-ordered.
+    int add_node(int parent_node);
+
+    void set_local(int node, mat4x4 matrix);
+
+    // Recomputes the world matrix of every node whose local transform or any ancestor's
+    // changed since the last call; returns how many were recomputed
+    size_t update();
+
+private:
+    size_t dirty_count = 0;
+};
+
+#endif
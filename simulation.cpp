@@ -0,0 +1,170 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// Speed an axis reaches while its control is held (radians or view units per second).
+// Matches the old 0.05 step per key repeat at a typical 30 Hz repeat rate.
+static const float AXIS_SPEED = 1.5f;
+
+// How quickly an axis eases towards its target speed, per second
+static const float SIM_RESPONSE = 10.0f;
+
+// Below this speed a released axis stops outright instead of creeping forever
+static const float SIM_REST_SPEED = 1e-3f;
+
+// A simulation further behind than this many ticks (stalled process, debugger) skips
+// ahead instead of running the backlog in a burst
+static const int SIM_MAX_CATCH_UP = 5;
+
+static const unsigned SLOT_MASK = 3;
+
+void SnapshotBuffer::publish()
+{
+    back_slot = middle.exchange(back_slot | FRESH, std::memory_order_acq_rel) & SLOT_MASK;
+}
+
+bool SnapshotBuffer::acquire()
+{
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+        return false;
+
+    front_slot = middle.exchange(front_slot, std::memory_order_acq_rel) & SLOT_MASK;
+    return true;
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start(std::function<void()> callback)
+{
+    notify = callback;
+    running = true;
+    thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    if (thread.joinable())
+    {
+        running = false;
+        thread.join();
+    }
+}
+
+void Simulation::set_control(unsigned control, bool held)
+{
+    if (held)
+        controls.fetch_or(control, std::memory_order_relaxed);
+    else
+        controls.fetch_and(~control, std::memory_order_relaxed);
+}
+
+void Simulation::reset()
+{
+    reset_requested = true;
+}
+
+void Simulation::step(SimState &state, unsigned held, float dt)
+{
+    float blend = std::min(1.0f, SIM_RESPONSE * dt);
+    for (int axis = 0; axis < AXIS_COUNT; axis++)
+    {
+        float target = 0;
+        if (held & sim_control((SimAxis)axis, true))
+            target += AXIS_SPEED;
+        if (held & sim_control((SimAxis)axis, false))
+            target -= AXIS_SPEED;
+
+        float &velocity = state.velocity[axis];
+        velocity += (target - velocity) * blend;
+        if (target == 0 && std::fabs(velocity) < SIM_REST_SPEED)
+            velocity = 0;
+        state.value[axis] += velocity * dt;
+    }
+
+    state.time += dt;
+    state.tick++;
+}
+
+void Simulation::run()
+{
+    const std::chrono::nanoseconds tick_length(1000000000 / SIM_TICK_RATE);
+    const float dt = 1.0f / SIM_TICK_RATE;
+
+    SimState state = {};
+    std::chrono::steady_clock::time_point next_tick = std::chrono::steady_clock::now();
+    while (running)
+    {
+        if (reset_requested.exchange(false))
+        {
+            memset(state.value, 0, sizeof(state.value));
+            memset(state.velocity, 0, sizeof(state.velocity));
+        }
+
+        SimSnapshot &snapshot = snapshots.back();
+        snapshot.previous = state;
+        step(state, controls.load(std::memory_order_relaxed), dt);
+        snapshot.current = state;
+        snapshot.published = std::chrono::steady_clock::now();
+        bool changed = memcmp(snapshot.previous.value, state.value, sizeof(state.value)) != 0;
+        snapshots.publish();
+        ticks++;
+        if (changed && notify)
+            notify();
+
+        next_tick += tick_length;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now < next_tick)
+        {
+            std::this_thread::sleep_until(next_tick);
+            continue;
+        }
+
+        late_ticks++;
+        if (now - next_tick > tick_length * SIM_MAX_CATCH_UP)
+        {
+            dropped_ticks += (now - next_tick) / tick_length;
+            next_tick = now;
+        }
+    }
+}
+
+bool Simulation::sample(std::chrono::steady_clock::time_point now, SimState &state)
+{
+    snapshots.acquire();
+    const SimSnapshot &snapshot = snapshots.front();
+    if (snapshot.current.tick == 0)
+        return false;
+
+    // The newest tick is shown one tick after it was computed, so there is always a
+    // later state to blend towards
+    float alpha = std::chrono::duration<float>(now - snapshot.published).count() * SIM_TICK_RATE;
+    alpha = std::min(std::max(alpha, 0.0f), 1.0f);
+
+    in_motion = false;
+    for (int axis = 0; axis < AXIS_COUNT; axis++)
+    {
+        float from = snapshot.previous.value[axis];
+        state.value[axis] = from + (snapshot.current.value[axis] - from) * alpha;
+        state.velocity[axis] = snapshot.current.velocity[axis];
+        if (snapshot.previous.velocity[axis] != 0 || snapshot.current.velocity[axis] != 0)
+            in_motion = true;
+    }
+    state.time = snapshot.previous.time + (snapshot.current.time - snapshot.previous.time) * alpha;
+    state.tick = snapshot.current.tick;
+    return true;
+}
+
+void Simulation::print_stats() const
+{
+    if (ticks == 0)
+        return;
+
+    std::cout << "Simulation: " << ticks << " ticks at " << SIM_TICK_RATE << " Hz, " << late_ticks
+              << " finished late, " << dropped_ticks << " skipped" << std::endl;
+}
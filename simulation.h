@@ -0,0 +1,121 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// Simulation ticks per second
+const int SIM_TICK_RATE = 60;
+
+// Quantities the simulation moves: model orientation, then the camera
+enum SimAxis
+{
+    AXIS_ROTATION_X,
+    AXIS_ROTATION_Y,
+    AXIS_ROTATION_Z,
+    AXIS_CAMERA_Y,
+    AXIS_ZOOM,
+    AXIS_CENTER_X,
+    AXIS_CENTER_Y,
+    AXIS_CENTER_Z,
+    AXIS_COUNT
+};
+
+// Held controls push an axis up or down; control bit 2 * axis raises it, 2 * axis + 1 lowers it
+inline unsigned sim_control(SimAxis axis, bool increase)
+{
+    return 1u << (axis * 2 + (increase ? 0 : 1));
+}
+
+struct SimState
+{
+    float value[AXIS_COUNT];
+    float velocity[AXIS_COUNT]; // units per second
+    float time;                 // simulated seconds, drives the formation's animation
+    uint64_t tick;
+};
+
+// What one tick publishes: the state before and after it, so the renderer can blend
+// between two consecutive ticks whatever it missed in between
+struct SimSnapshot
+{
+    SimState previous;
+    SimState current;
+    std::chrono::steady_clock::time_point published;
+};
+
+// Single-producer, single-consumer handoff of the newest snapshot without locks. Each
+// side owns one slot; the third is swapped atomically between them, tagged when it
+// holds a snapshot the reader has not seen yet. Neither side ever waits.
+struct SnapshotBuffer
+{
+    // Writer: the slot to fill, then publish() to hand it over
+    SimSnapshot &back() { return slots[back_slot]; }
+    void publish();
+
+    // Reader: takes the newest published snapshot if there is one; front() stays valid
+    // until the next successful acquire()
+    bool acquire();
+    const SimSnapshot &front() const { return slots[front_slot]; }
+
+private:
+    static const unsigned FRESH = 4;
+    SimSnapshot slots[3] = {};
+    std::atomic<unsigned> middle{2};
+    unsigned back_slot = 1;
+    unsigned front_slot = 0;
+};
+
+// Fixed-timestep simulation on its own thread. Input arrives as a bitmask of held
+// controls, so motion depends on how long a key is held rather than on the keyboard
+// repeat rate. Each axis eases towards its target speed, glides to a stop on release,
+// and each tick publishes a snapshot the render thread interpolates from.
+struct Simulation
+{
+    Simulation() = default;
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+    ~Simulation();
+
+    // notify is called from the simulation thread after each tick that changed the state
+    // (to wake up a render loop sleeping on events)
+    void start(std::function<void()> notify);
+    void stop();
+
+    // Input from the event thread; takes effect at the next tick
+    void set_control(unsigned control, bool held);
+    void reset();
+
+    // Render thread: the state at time now, interpolated between the two sides of the
+    // newest snapshot. Returns false until the first tick has been published.
+    bool sample(std::chrono::steady_clock::time_point now, SimState &state);
+
+    // True while any axis is still moving in the last sampled state
+    bool moving() const { return in_motion; }
+
+    // Advances state by one tick under the given controls
+    static void step(SimState &state, unsigned controls, float dt);
+
+    void print_stats() const;
+
+private:
+    std::thread thread;
+    std::function<void()> notify;
+    std::atomic<bool> running{false};
+    std::atomic<unsigned> controls{0};
+    std::atomic<bool> reset_requested{false};
+    SnapshotBuffer snapshots;
+    bool in_motion = false;
+
+    // Written by the simulation thread, read after stop()
+    long ticks = 0;
+    long late_ticks = 0;
+    long dropped_ticks = 0;
+
+    void run();
+};
+
+#endif
@@ -0,0 +1,472 @@
+#include "soft_raster.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Sub-pixel precision of the fixed-point vertex positions: 1/256 pixel, the precision GPUs
+// commonly snap to, so tiny triangles cover the same pixels as on the GL path
+static const int SUBPIXEL_BITS = 8;
+static const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+
+// Triangles reaching further than this many pixels outside the viewport are clipped, which
+// keeps every edge function inside a raster block within 32-bit range (for viewports up to
+// 1920x1080: (width + height + 4 * guard band) * 256 * 7 * 256 < 2^31)
+static const float GUARD_BAND = 256.0f;
+
+// Tiles are rasterized in blocks of this many pixels square, skipped or filled without an
+// edge test when a triangle misses or covers them entirely
+static const int RASTER_BLOCK = 8;
+
+// Vertices this close to the eye plane (or behind it) are clipped away
+static const float W_EPSILON = 1e-5f;
+
+// Triangle batches binned in parallel, per thread; more than one lets stealing even out
+static const unsigned BATCHES_PER_THREAD = 4;
+
+static uint32_t pack_color(float r, float g, float b, float a)
+{
+    uint32_t channels[4];
+    const float values[4] = {r, g, b, a};
+    for (int i = 0; i < 4; i++)
+        channels[i] = (uint32_t)(std::min(std::max(values[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+    return channels[0] | channels[1] << 8 | channels[2] << 16 | channels[3] << 24;
+}
+
+void SoftRasterizer::init(int frame_width, int frame_height, unsigned threads)
+{
+    width = frame_width;
+    height = frame_height;
+    stride = (width + 3) & ~3;
+    color.assign((size_t)stride * height, 0);
+    depth.assign((size_t)stride * height, 1.0f);
+
+    tiles_x = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    tiles_y = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+
+    pool.stop();
+    pool.start(threads);
+    batches = std::vector<Batch>(pool.size() * BATCHES_PER_THREAD);
+    for (Batch &batch : batches)
+        batch.bins.resize((size_t)tiles_x * tiles_y);
+}
+
+void SoftRasterizer::render(const std::vector<SoftDraw> &draws, const float clear_color[4])
+{
+    std::copy(clear_color, clear_color + 4, clear_rgba);
+    clear_pixel = pack_color(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+
+    vertex_base.resize(draws.size());
+    triangle_base.resize(draws.size() + 1);
+    size_t vertex_total = 0, triangle_total = 0;
+    for (size_t i = 0; i < draws.size(); i++)
+    {
+        vertex_base[i] = vertex_total;
+        triangle_base[i] = triangle_total;
+        vertex_total += draws[i].mesh->vertex_count;
+        triangle_total += draws[i].index_count / 3;
+    }
+    triangle_base[draws.size()] = triangle_total;
+    vertices.resize(vertex_total);
+    triangle_count = triangle_total;
+
+    auto start = std::chrono::steady_clock::now();
+    pool.parallel_for(draws.size(), [&](size_t draw, unsigned) { transform_draw(draws[draw], draw); });
+    auto transformed = std::chrono::steady_clock::now();
+
+    pool.parallel_for(batches.size(), [&](size_t batch, unsigned) { bin_batch(draws, batch); });
+    auto binned = std::chrono::steady_clock::now();
+
+    pool.parallel_for((size_t)tiles_x * tiles_y, [&](size_t tile, unsigned) { raster_tile(tile); });
+    auto rasterized = std::chrono::steady_clock::now();
+
+    bin_entries = 0;
+    for (const Batch &batch : batches)
+    {
+        for (const std::vector<uint32_t> &bin : batch.bins)
+            bin_entries += bin.size();
+    }
+
+    transform_ms = std::chrono::duration<double, std::milli>(transformed - start).count();
+    bin_ms = std::chrono::duration<double, std::milli>(binned - transformed).count();
+    raster_ms = std::chrono::duration<double, std::milli>(rasterized - binned).count();
+}
+
+void SoftRasterizer::transform_draw(const SoftDraw &draw, size_t draw_index)
+{
+    const GLfloat *source = draw.mesh->data();
+    ClipVertex *out = &vertices[vertex_base[draw_index]];
+    const vec4 *m = draw.matrix;
+
+    for (GLsizei v = 0; v < draw.mesh->vertex_count; v++, source += VERTEX_SIZE, out++)
+    {
+        for (int row = 0; row < 4; row++)
+            out->position[row] = m[0][row] * source[0] + m[1][row] * source[1] + m[2][row] * source[2] + m[3][row];
+        for (int channel = 0; channel < 3; channel++)
+            out->color[channel] = source[3 + channel] * draw.tint[channel];
+    }
+}
+
+void SoftRasterizer::bin_batch(const std::vector<SoftDraw> &draws, size_t batch_index)
+{
+    Batch &batch = batches[batch_index];
+    batch.triangles.clear();
+    for (std::vector<uint32_t> &bin : batch.bins)
+        bin.clear();
+
+    size_t first = triangle_count * batch_index / batches.size();
+    size_t last = triangle_count * (batch_index + 1) / batches.size();
+    if (first == last)
+        return;
+
+    float guard_x = 1.0f + 2.0f * GUARD_BAND / width;
+    float guard_y = 1.0f + 2.0f * GUARD_BAND / height;
+
+    size_t draw = std::upper_bound(triangle_base.begin(), triangle_base.end(), first) - triangle_base.begin() - 1;
+    for (size_t t = first; t < last; t++)
+    {
+        while (t >= triangle_base[draw + 1])
+            draw++;
+
+        const SoftDraw &source = draws[draw];
+        const GLuint *indices = source.mesh->index_data() + source.index_offset + (t - triangle_base[draw]) * 3;
+        const ClipVertex *base = &vertices[vertex_base[draw]];
+        const ClipVertex &a = base[indices[0]], &b = base[indices[1]], &c = base[indices[2]];
+
+        // Outcodes against the eye plane and the guard band; most triangles are entirely inside
+        unsigned outside_all = ~0u, outside_any = 0;
+        for (const ClipVertex *vertex : {&a, &b, &c})
+        {
+            float x = vertex->position[0], y = vertex->position[1], w = vertex->position[3];
+            unsigned code = (w <= W_EPSILON) | (x > guard_x * w) << 1 | (x < -guard_x * w) << 2 |
+                            (y > guard_y * w) << 3 | (y < -guard_y * w) << 4;
+            outside_all &= code;
+            outside_any |= code;
+        }
+
+        if (outside_all)
+            continue;
+        if (outside_any)
+            clip_triangle(batch, a, b, c);
+        else
+            setup_triangle(batch, a, b, c);
+    }
+}
+
+void SoftRasterizer::clip_triangle(Batch &batch, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c)
+{
+    // Sutherland-Hodgman against each clip plane in turn; every plane adds at most one vertex
+    ClipVertex polygon[2][8];
+    int count = 3;
+    polygon[0][0] = a;
+    polygon[0][1] = b;
+    polygon[0][2] = c;
+
+    float guard_x = 1.0f + 2.0f * GUARD_BAND / width;
+    float guard_y = 1.0f + 2.0f * GUARD_BAND / height;
+    auto distance = [&](const ClipVertex &vertex, int plane)
+    {
+        const float *p = vertex.position;
+        switch (plane)
+        {
+        case 0:
+            return p[3] - W_EPSILON;
+        case 1:
+            return guard_x * p[3] - p[0];
+        case 2:
+            return guard_x * p[3] + p[0];
+        case 3:
+            return guard_y * p[3] - p[1];
+        default:
+            return guard_y * p[3] + p[1];
+        }
+    };
+
+    int current = 0;
+    for (int plane = 0; plane < 5 && count >= 3; plane++)
+    {
+        const ClipVertex *in = polygon[current];
+        ClipVertex *out = polygon[current ^ 1];
+        int out_count = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const ClipVertex &from = in[i], &to = in[(i + 1) % count];
+            float d_from = distance(from, plane), d_to = distance(to, plane);
+            if (d_from >= 0)
+                out[out_count++] = from;
+            if ((d_from >= 0) != (d_to >= 0))
+            {
+                float t = d_from / (d_from - d_to);
+                ClipVertex &split = out[out_count++];
+                for (int k = 0; k < 4; k++)
+                    split.position[k] = from.position[k] + (to.position[k] - from.position[k]) * t;
+                for (int k = 0; k < 3; k++)
+                    split.color[k] = from.color[k] + (to.color[k] - from.color[k]) * t;
+            }
+        }
+        count = out_count;
+        current ^= 1;
+    }
+
+    for (int i = 1; i + 1 < count; i++)
+        setup_triangle(batch, polygon[current][0], polygon[current][i], polygon[current][i + 1]);
+}
+
+void SoftRasterizer::setup_triangle(Batch &batch, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c)
+{
+    const ClipVertex *corners[3] = {&a, &b, &c};
+    Triangle triangle;
+    double attributes[5][3];
+    for (int i = 0; i < 3; i++)
+    {
+        const ClipVertex &vertex = *corners[i];
+        float inv_w = 1.0f / vertex.position[3];
+        float screen_x = (vertex.position[0] * inv_w * 0.5f + 0.5f) * width;
+        float screen_y = (vertex.position[1] * inv_w * 0.5f + 0.5f) * height;
+        triangle.x[i] = (int32_t)lrintf(screen_x * SUBPIXEL_ONE);
+        triangle.y[i] = (int32_t)lrintf(screen_y * SUBPIXEL_ONE);
+
+        attributes[0][i] = vertex.position[2] * inv_w * 0.5f + 0.5f;
+        attributes[1][i] = inv_w;
+        for (int channel = 0; channel < 3; channel++)
+            attributes[2 + channel][i] = vertex.color[channel] * inv_w;
+    }
+
+    int64_t area = (int64_t)(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                   (int64_t)(triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+    if (area == 0)
+        return;
+
+    // No face culling on the GL side either: clockwise triangles are turned around
+    if (area < 0)
+    {
+        std::swap(triangle.x[1], triangle.x[2]);
+        std::swap(triangle.y[1], triangle.y[2]);
+        for (double *attribute : attributes)
+            std::swap(attribute[1], attribute[2]);
+    }
+
+    // Pixels whose centre (256 * p + 128 in fixed point) lies within the vertex bounds
+    int32_t low_x = std::min({triangle.x[0], triangle.x[1], triangle.x[2]});
+    int32_t high_x = std::max({triangle.x[0], triangle.x[1], triangle.x[2]});
+    int32_t low_y = std::min({triangle.y[0], triangle.y[1], triangle.y[2]});
+    int32_t high_y = std::max({triangle.y[0], triangle.y[1], triangle.y[2]});
+    triangle.min_x = std::max((low_x - SUBPIXEL_ONE / 2 + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS, 0);
+    triangle.max_x = std::min((high_x - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS, width - 1);
+    triangle.min_y = std::max((low_y - SUBPIXEL_ONE / 2 + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS, 0);
+    triangle.max_y = std::min((high_y - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS, height - 1);
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+        return;
+
+    // Attribute planes over the snapped positions, in pixels
+    double x0 = triangle.x[0] / (double)SUBPIXEL_ONE, y0 = triangle.y[0] / (double)SUBPIXEL_ONE;
+    double x1 = triangle.x[1] / (double)SUBPIXEL_ONE - x0, y1 = triangle.y[1] / (double)SUBPIXEL_ONE - y0;
+    double x2 = triangle.x[2] / (double)SUBPIXEL_ONE - x0, y2 = triangle.y[2] / (double)SUBPIXEL_ONE - y0;
+    double inv_area = 1.0 / (x1 * y2 - x2 * y1);
+    for (int i = 0; i < 5; i++)
+    {
+        double d1 = attributes[i][1] - attributes[i][0];
+        double d2 = attributes[i][2] - attributes[i][0];
+        double dx = (d1 * y2 - d2 * y1) * inv_area;
+        double dy = (d2 * x1 - d1 * x2) * inv_area;
+        triangle.plane[i][0] = (float)(attributes[i][0] - dx * x0 - dy * y0);
+        triangle.plane[i][1] = (float)dx;
+        triangle.plane[i][2] = (float)dy;
+    }
+
+    uint32_t index = (uint32_t)batch.triangles.size();
+    batch.triangles.push_back(triangle);
+    for (int tile_y = triangle.min_y / SOFT_TILE_SIZE; tile_y <= triangle.max_y / SOFT_TILE_SIZE; tile_y++)
+    {
+        for (int tile_x = triangle.min_x / SOFT_TILE_SIZE; tile_x <= triangle.max_x / SOFT_TILE_SIZE; tile_x++)
+            batch.bins[(size_t)tile_y * tiles_x + tile_x].push_back(index);
+    }
+}
+
+void SoftRasterizer::raster_tile(size_t tile)
+{
+    int tile_x0 = (int)(tile % tiles_x) * SOFT_TILE_SIZE;
+    int tile_y0 = (int)(tile / tiles_x) * SOFT_TILE_SIZE;
+    int tile_x1 = std::min(tile_x0 + SOFT_TILE_SIZE, width) - 1;
+    int tile_y1 = std::min(tile_y0 + SOFT_TILE_SIZE, height) - 1;
+
+    for (int y = tile_y0; y <= tile_y1; y++)
+    {
+        size_t row = (size_t)y * stride;
+        std::fill(color.begin() + row + tile_x0, color.begin() + row + tile_x1 + 1, clear_pixel);
+        std::fill(depth.begin() + row + tile_x0, depth.begin() + row + tile_x1 + 1, 1.0f);
+    }
+
+    for (const Batch &batch : batches)
+    {
+        for (uint32_t index : batch.bins[tile])
+            raster_triangle(batch.triangles[index], tile_x0, tile_y0, tile_x1, tile_y1);
+    }
+}
+
+void SoftRasterizer::raster_triangle(const Triangle &triangle, int tile_x0, int tile_y0, int tile_x1, int tile_y1)
+{
+    int x0 = std::max(triangle.min_x, tile_x0), x1 = std::min(triangle.max_x, tile_x1);
+    int y0 = std::max(triangle.min_y, tile_y0), y1 = std::min(triangle.max_y, tile_y1);
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // Edge i is opposite vertex i: E(px, py) = a * px + b * py + c at pixel centres, positive
+    // inside. Pixels exactly on an edge belong to it only on left and top edges, the others
+    // fold a bias of -1 into c.
+    int64_t a[3], b[3], c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        a[i] = (int64_t)triangle.y[j] - triangle.y[k];
+        b[i] = (int64_t)triangle.x[k] - triangle.x[j];
+        c[i] = -(a[i] * triangle.x[j] + b[i] * triangle.y[j]) - ((a[i] > 0 || (a[i] == 0 && b[i] < 0)) ? 0 : 1);
+    }
+
+    // Blocks start on multiples of RASTER_BLOCK so rows of the framebuffer stay aligned
+    const int64_t span = (int64_t)(RASTER_BLOCK - 1) * SUBPIXEL_ONE;
+    for (int block_y = y0 & ~(RASTER_BLOCK - 1); block_y <= y1; block_y += RASTER_BLOCK)
+    {
+        for (int block_x = x0 & ~(RASTER_BLOCK - 1); block_x <= x1; block_x += RASTER_BLOCK)
+        {
+            // The extremes of each edge over the block's pixel centres decide whether the block
+            // is skipped, whether the edge matters in it at all, and otherwise bound the edge's
+            // values within the block well inside 32 bits
+            int32_t value[3], step_x[3], step_y[3];
+            bool outside = false;
+            for (int i = 0; i < 3 && !outside; i++)
+            {
+                int64_t corner = a[i] * ((int64_t)block_x * SUBPIXEL_ONE + SUBPIXEL_ONE / 2) +
+                                 b[i] * ((int64_t)block_y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2) + c[i];
+                int64_t low = corner + std::min<int64_t>(a[i] * span, 0) + std::min<int64_t>(b[i] * span, 0);
+                int64_t high = corner + std::max<int64_t>(a[i] * span, 0) + std::max<int64_t>(b[i] * span, 0);
+                if (high < 0)
+                {
+                    outside = true;
+                }
+                else if (low >= 0)
+                {
+                    value[i] = step_x[i] = step_y[i] = 0;
+                }
+                else
+                {
+                    value[i] = (int32_t)corner;
+                    step_x[i] = (int32_t)(a[i] * SUBPIXEL_ONE);
+                    step_y[i] = (int32_t)(b[i] * SUBPIXEL_ONE);
+                }
+            }
+
+            if (!outside)
+            {
+                raster_block(triangle, block_x, block_y, value, step_x, step_y,
+                             std::max(x0, block_x), std::min(x1, block_x + RASTER_BLOCK - 1),
+                             std::max(y0, block_y), std::min(y1, block_y + RASTER_BLOCK - 1));
+            }
+        }
+    }
+}
+
+void SoftRasterizer::raster_block(const Triangle &triangle, int block_x, int block_y, const int32_t value[3],
+                                  const int32_t step_x[3], const int32_t step_y[3], int x0, int x1, int y0, int y1)
+{
+    const float (*plane)[3] = triangle.plane;
+
+#if defined(__SSE2__)
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128 lane_f = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128i minus_one = _mm_set1_epi32(-1);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+    const __m128i first_column = _mm_set1_epi32(x0 - 1), last_column = _mm_set1_epi32(x1 + 1);
+
+    __m128i edge_lanes[3];
+    for (int i = 0; i < 3; i++)
+        edge_lanes[i] = _mm_setr_epi32(0, step_x[i], step_x[i] * 2, step_x[i] * 3);
+
+    for (int y = y0; y <= y1; y++)
+    {
+        float center_y = y + 0.5f;
+        uint32_t *color_row = &color[(size_t)y * stride];
+        float *depth_row = &depth[(size_t)y * stride];
+
+        for (int x = block_x; x < block_x + RASTER_BLOCK; x += 4)
+        {
+            if (x > x1 || x + 3 < x0)
+                continue;
+
+            __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(_mm_add_epi32(_mm_set1_epi32(x), lane), first_column),
+                                           _mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(x), lane), last_column));
+            for (int i = 0; i < 3; i++)
+            {
+                int32_t start = value[i] + (x - block_x) * step_x[i] + (y - block_y) * step_y[i];
+                __m128i edge = _mm_add_epi32(_mm_set1_epi32(start), edge_lanes[i]);
+                inside = _mm_and_si128(inside, _mm_cmpgt_epi32(edge, minus_one));
+            }
+            if (!_mm_movemask_epi8(inside))
+                continue;
+
+            float center_x = x + 0.5f;
+            __m128 attribute[5];
+            for (int i = 0; i < 5; i++)
+            {
+                float start = plane[i][0] + plane[i][1] * center_x + plane[i][2] * center_y;
+                attribute[i] = _mm_add_ps(_mm_set1_ps(start), _mm_mul_ps(lane_f, _mm_set1_ps(plane[i][1])));
+            }
+
+            // GL_LESS against the stored depth, and only within the depth range (z clipping)
+            __m128 z = attribute[0];
+            __m128 stored = _mm_loadu_ps(depth_row + x);
+            __m128 pass = _mm_and_ps(_mm_cmplt_ps(z, stored), _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one)));
+            __m128i write = _mm_and_si128(inside, _mm_castps_si128(pass));
+            if (!_mm_movemask_epi8(write))
+                continue;
+
+            __m128 w = _mm_div_ps(one, attribute[1]);
+            __m128i packed = alpha;
+            for (int channel = 0; channel < 3; channel++)
+            {
+                __m128 channel_value = _mm_min_ps(_mm_max_ps(_mm_mul_ps(attribute[2 + channel], w), zero), one);
+                __m128i byte = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(channel_value, scale), half));
+                packed = _mm_or_si128(packed, _mm_slli_epi32(byte, channel * 8));
+            }
+
+            __m128 write_f = _mm_castsi128_ps(write);
+            _mm_storeu_ps(depth_row + x, _mm_or_ps(_mm_and_ps(write_f, z), _mm_andnot_ps(write_f, stored)));
+            __m128i old = _mm_loadu_si128((const __m128i *)(color_row + x));
+            _mm_storeu_si128((__m128i *)(color_row + x), _mm_or_si128(_mm_and_si128(write, packed), _mm_andnot_si128(write, old)));
+        }
+    }
+#else
+    for (int y = y0; y <= y1; y++)
+    {
+        float center_y = y + 0.5f;
+        uint32_t *color_row = &color[(size_t)y * stride];
+        float *depth_row = &depth[(size_t)y * stride];
+
+        for (int x = x0; x <= x1; x++)
+        {
+            bool inside = true;
+            for (int i = 0; i < 3; i++)
+                inside = inside && value[i] + (x - block_x) * step_x[i] + (y - block_y) * step_y[i] >= 0;
+            if (!inside)
+                continue;
+
+            float px = x + 0.5f;
+            float z = plane[0][0] + plane[0][1] * px + plane[0][2] * center_y;
+            if (z < depth_row[x] && z >= 0.0f && z <= 1.0f)
+            {
+                float w = 1.0f / (plane[1][0] + plane[1][1] * px + plane[1][2] * center_y);
+                float rgb[3];
+                for (int channel = 0; channel < 3; channel++)
+                    rgb[channel] = (plane[2 + channel][0] + plane[2 + channel][1] * px + plane[2 + channel][2] * center_y) * w;
+                depth_row[x] = z;
+                color_row[x] = pack_color(rgb[0], rgb[1], rgb[2], 1.0f);
+            }
+        }
+    }
+#endif
+}
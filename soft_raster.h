@@ -0,0 +1,99 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+#include <cstdint>
+#include <vector>
+
+// Linmath
+#include "deps/linmath.h"
+
+#include "mesh.h"
+#include "work_pool.h"
+
+// Screen tiles are the unit of parallel rasterization
+const int SOFT_TILE_SIZE = 64;
+
+// One instance of a mesh level: index_count indices from index_offset, transformed by
+// matrix (mvp * instance_model * rotation_mat, as in the vertex shader) and tinted
+struct SoftDraw
+{
+    const Mesh *mesh;
+    GLuint index_offset;
+    GLsizei index_count;
+    mat4x4 matrix;
+    float tint[3];
+};
+
+// CPU fallback for machines without a GPU, producing the same image as the GL path
+// (triangles, interpolated vertex colors, GL_LESS depth test). A frame runs in three
+// parallel passes on a WorkPool:
+//   1. vertices of every draw are transformed to clip space,
+//   2. triangles are clipped to a guard band, set up in fixed point (1/256 pixel, top-left
+//      fill rule) and binned into the SOFT_TILE_SIZE tiles their bounds touch,
+//   3. tiles are rasterized independently in 8x8 blocks with SSE2 edge functions, four
+//      pixels at a time.
+// Binning works on contiguous triangle ranges, so every tile sees its triangles in
+// submission order and depth ties resolve as they do on the GPU.
+struct SoftRasterizer
+{
+    int width = 0, height = 0;
+    int stride = 0;              // pixels per row, a multiple of 4
+    std::vector<uint32_t> color; // RGBA8 bytes, bottom row first like glReadPixels
+    std::vector<float> depth;
+
+    // Per-frame pass timings and counts of the last render()
+    double transform_ms = 0, bin_ms = 0, raster_ms = 0;
+    size_t triangle_count = 0, bin_entries = 0;
+
+    void init(int width, int height, unsigned thread_count);
+    unsigned thread_count() const { return pool.size(); }
+
+    // Clears to clear_color (RGBA, 0..1) and draws everything in order
+    void render(const std::vector<SoftDraw> &draws, const float clear_color[4]);
+
+    // Ranges the tile pass took from another thread since init
+    long steals() const { return pool.steals(); }
+
+private:
+    struct ClipVertex
+    {
+        float position[4];
+        float color[3];
+    };
+
+    // Fixed-point corners plus attribute planes f(x, y) = f0 + dx * x + dy * y in pixels
+    struct Triangle
+    {
+        int32_t x[3], y[3];
+        int32_t min_x, min_y, max_x, max_y; // pixel bounds, inclusive
+        float plane[5][3];                  // depth, 1/w, red/w, green/w, blue/w
+    };
+
+    WorkPool pool;
+    int tiles_x = 0, tiles_y = 0;
+    float clear_rgba[4];
+    uint32_t clear_pixel = 0;
+
+    std::vector<ClipVertex> vertices;
+    std::vector<size_t> vertex_base;   // per draw, first entry in vertices
+    std::vector<size_t> triangle_base; // per draw, first triangle; one extra entry at the end
+
+    // Binning splits the triangles into batches; each keeps its own triangles and per-tile lists
+    struct Batch
+    {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t>> bins;
+    };
+    std::vector<Batch> batches;
+
+    void transform_draw(const SoftDraw &draw, size_t draw_index);
+    void bin_batch(const std::vector<SoftDraw> &draws, size_t batch_index);
+    void setup_triangle(Batch &batch, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c);
+    void clip_triangle(Batch &batch, const ClipVertex &a, const ClipVertex &b, const ClipVertex &c);
+    void raster_tile(size_t tile);
+    void raster_triangle(const Triangle &triangle, int tile_x0, int tile_y0, int tile_x1, int tile_y1);
+    void raster_block(const Triangle &triangle, int block_x, int block_y, const int32_t value[3],
+                      const int32_t step_x[3], const int32_t step_y[3], int x0, int x1, int y0, int y1);
+};
+
+#endif
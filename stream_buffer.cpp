@@ -0,0 +1,138 @@
+#include "stream_buffer.h"
+
+#include <chrono>
+#include <iostream>
+
+static const size_t STREAM_BUFFER_ALIGNMENT = 64;
+
+void StreamBuffer::init(GLenum buffer_target, size_t size)
+{
+    target = buffer_target;
+    region_size = (size + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+    persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, region_size * STREAM_BUFFER_REGIONS, nullptr, flags);
+        mapping = (char *)glMapBufferRange(target, 0, region_size * STREAM_BUFFER_REGIONS, flags);
+        if (!mapping)
+        {
+            // Immutable storage can't be resized into a plain buffer, start over with a new name
+            glBindBuffer(target, 0);
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+            persistent = false;
+        }
+    }
+    if (!persistent)
+        glBufferData(target, region_size * STREAM_BUFFER_REGIONS, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(target, 0);
+}
+
+void StreamBuffer::destroy()
+{
+    for (GLsync &region_fence : fences)
+    {
+        if (region_fence)
+            glDeleteSync(region_fence);
+        region_fence = 0;
+    }
+
+    if (mapping)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        mapping = nullptr;
+    }
+
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void *StreamBuffer::begin_write(GLintptr &offset)
+{
+    region = (region + 1) % STREAM_BUFFER_REGIONS;
+    offset = region * region_size;
+    frames++;
+
+    if (fences[region])
+    {
+        // A zero timeout only polls; anything but "signaled" means the GPU still reads the region
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED && persistent)
+        {
+            auto wait_start = std::chrono::steady_clock::now();
+            fence_waits++;
+            do
+            {
+                status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+
+            double waited = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+            wait_ms += waited;
+            if (waited > max_wait_ms)
+                max_wait_ms = waited;
+        }
+
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            // Fallback path: detach the storage the GPU still reads and take fresh memory,
+            // which also retires every other region's fence
+            orphans++;
+            glBindBuffer(target, buffer);
+            glBufferData(target, region_size * STREAM_BUFFER_REGIONS, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(target, 0);
+            for (GLsync &region_fence : fences)
+            {
+                if (region_fence)
+                    glDeleteSync(region_fence);
+                region_fence = 0;
+            }
+        }
+        else
+        {
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+    }
+
+    if (persistent)
+        return mapping + offset;
+
+    glBindBuffer(target, buffer);
+    void *pointer = glMapBufferRange(target, offset, region_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(target, 0);
+    return pointer;
+}
+
+void StreamBuffer::end_write()
+{
+    // Coherent persistent writes are visible to commands issued afterwards without a flush
+    if (persistent)
+        return;
+
+    glBindBuffer(target, buffer);
+    glUnmapBuffer(target);
+    glBindBuffer(target, 0);
+}
+
+void StreamBuffer::fence()
+{
+    // Frames that draw from a region without rewriting it replace its fence with a later one
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void StreamBuffer::print_stats() const
+{
+    std::cout << "Stream buffer (" << (persistent ? "persistent mapped" : "unsynchronized + orphaning") << ", "
+              << STREAM_BUFFER_REGIONS << " x " << region_size << " bytes): " << frames << " frames, "
+              << fence_waits << " fence waits (" << wait_ms << " ms total, " << max_wait_ms << " ms max), "
+              << orphans << " orphans" << std::endl;
+}
@@ -0,0 +1,58 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <cstddef>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Regions the CPU cycles through: one being written, up to two still read by queued frames
+const int STREAM_BUFFER_REGIONS = 3;
+
+// Buffer for data rewritten every frame (animated instances, debug lines, ribbons).
+// It is split into STREAM_BUFFER_REGIONS regions, each guarded by a fence placed after
+// the draws that read it, so the CPU fills one region while the GPU reads the others.
+//
+// With GL 4.4 / ARB_buffer_storage the storage is mapped once, persistent and coherent,
+// and writes go straight into it. Otherwise (GL 3.3) each region is mapped unsynchronized
+// for the write, and when its fence is still pending the whole buffer is orphaned instead
+// of waiting.
+struct StreamBuffer
+{
+    GLuint buffer = 0;
+    GLenum target = GL_ARRAY_BUFFER;
+    size_t region_size = 0;
+    bool persistent = false;
+
+    // Per-frame synchronization counters, see print_stats()
+    long frames = 0;
+    long fence_waits = 0;
+    long orphans = 0;
+    double wait_ms = 0;
+    double max_wait_ms = 0;
+
+    // Creates the buffer; region_size is rounded up so every region starts cache-line aligned
+    void init(GLenum target, size_t region_size);
+    void destroy();
+
+    // Returns a write pointer to the next free region, waiting for (or orphaning) the GPU if it
+    // still reads it. offset receives the region's byte offset to point attributes or draws at.
+    void *begin_write(GLintptr &offset);
+
+    // Ends the write (unmaps in the fallback path); the region can then be drawn from
+    void end_write();
+
+    // Call once the draws reading the current region have been submitted, also on frames
+    // that draw from it again without a new write
+    void fence();
+
+    void print_stats() const;
+
+private:
+    char *mapping = nullptr;
+    GLsync fences[STREAM_BUFFER_REGIONS] = {};
+    int region = STREAM_BUFFER_REGIONS - 1;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "transform_batch.h"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include "transform_batch_kernel.h"
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TRANSFORM_BATCH_AVX2 1
+// Defined in transform_batch_avx2.cpp, which is compiled for AVX2+FMA
+size_t compose_transforms_avx2(const TransformArrays &in, size_t count, const mat4x4 *view_projection, mat4x4 *out, size_t stride);
+#endif
+
+void TransformBatch::resize(size_t count)
+{
+    rotation_x.resize(count, 0.0f);
+    rotation_y.resize(count, 0.0f);
+    rotation_z.resize(count, 0.0f);
+    translation_x.resize(count, 0.0f);
+    translation_y.resize(count, 0.0f);
+    translation_z.resize(count, 0.0f);
+    scale.resize(count, 1.0f);
+}
+
+static TransformArrays arrays_of(const TransformBatch &batch)
+{
+    TransformArrays in = {
+        batch.rotation_x.data(), batch.rotation_y.data(), batch.rotation_z.data(),
+        batch.translation_x.data(), batch.translation_y.data(), batch.translation_z.data(),
+        batch.scale.data()};
+    return in;
+}
+
+static mat4x4 *matrix_at(mat4x4 *out, size_t index, size_t stride)
+{
+    return (mat4x4 *)((char *)out + index * stride);
+}
+
+// Closed form of translate * rotate_X * rotate_Y * rotate_Z * scale, see the SIMD kernel
+static void compose_scalar(const TransformArrays &in, size_t begin, size_t end, const mat4x4 *view_projection, mat4x4 *out, size_t stride)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        float sx = sinf(in.rotation_x[i]), cx = cosf(in.rotation_x[i]);
+        float sy = sinf(in.rotation_y[i]), cy = cosf(in.rotation_y[i]);
+        float sz = sinf(in.rotation_z[i]), cz = cosf(in.rotation_z[i]);
+        float s = in.scale[i];
+
+        float b[3][3] = {
+            {cy * cz, -cy * sz, -sy},
+            {cx * sz - sx * sy * cz, sx * sy * sz + cx * cz, -sx * cy},
+            {cx * sy * cz + sx * sz, sx * cz - cx * sy * sz, cx * cy}};
+
+        mat4x4 m;
+        for (int c = 0; c < 3; c++)
+        {
+            for (int r = 0; r < 3; r++)
+                m[c][r] = b[r][c] * s;
+            m[c][3] = 0.0f;
+        }
+        m[3][0] = in.translation_x[i];
+        m[3][1] = in.translation_y[i];
+        m[3][2] = in.translation_z[i];
+        m[3][3] = 1.0f;
+
+        mat4x4 *target = matrix_at(out, i, stride);
+        if (view_projection)
+            mat4x4_mul(*target, *(mat4x4 *)view_projection, m);
+        else
+            mat4x4_dup(*target, m);
+    }
+}
+
+#if defined(__SSE2__)
+namespace
+{
+
+struct SseOps
+{
+    typedef __m128 F;
+    typedef __m128i I;
+    static const int WIDTH = 4;
+
+    static F load(const float *p) { return _mm_loadu_ps(p); }
+    static F set1(float v) { return _mm_set1_ps(v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F madd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F and_(F a, F b) { return _mm_and_ps(a, b); }
+    static F andnot(F a, F b) { return _mm_andnot_ps(a, b); }
+    static F xor_(F a, F b) { return _mm_xor_ps(a, b); }
+    static F select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+    static I iset1(int v) { return _mm_set1_epi32(v); }
+    static I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+    static I isub(I a, I b) { return _mm_sub_epi32(a, b); }
+    static I iand(I a, I b) { return _mm_and_si128(a, b); }
+    static I iandnot(I a, I b) { return _mm_andnot_si128(a, b); }
+    static I icmpeq(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+    static I slli29(I a) { return _mm_slli_epi32(a, 29); }
+    static I cvtt(F a) { return _mm_cvttps_epi32(a); }
+    static F cvt(I a) { return _mm_cvtepi32_ps(a); }
+    static F cast(I a) { return _mm_castsi128_ps(a); }
+
+    // m holds one matrix element per lane; transposing each column gives per-object columns
+    static void store_matrices(F m[4][4], mat4x4 *out, size_t first, size_t stride)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            F r0 = m[c][0], r1 = m[c][1], r2 = m[c][2], r3 = m[c][3];
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps((*matrix_at(out, first + 0, stride))[c], r0);
+            _mm_storeu_ps((*matrix_at(out, first + 1, stride))[c], r1);
+            _mm_storeu_ps((*matrix_at(out, first + 2, stride))[c], r2);
+            _mm_storeu_ps((*matrix_at(out, first + 3, stride))[c], r3);
+        }
+    }
+};
+
+} // namespace
+#endif
+
+#if defined(TRANSFORM_BATCH_AVX2)
+static bool cpu_has_avx2()
+{
+    static bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return supported;
+}
+#endif
+
+void compose_transforms(const TransformBatch &batch, const mat4x4 *view_projection, mat4x4 *out, size_t stride)
+{
+    TransformArrays in = arrays_of(batch);
+    size_t count = batch.size(), done = 0;
+
+#if defined(TRANSFORM_BATCH_AVX2)
+    if (cpu_has_avx2())
+        done = compose_transforms_avx2(in, count, view_projection, out, stride);
+    else
+#endif
+#if defined(__SSE2__)
+        done = transform_kernel::compose<SseOps>(in, count, view_projection, out, stride);
+#endif
+
+    compose_scalar(in, done, count, view_projection, out, stride);
+}
+
+void compose_transforms_scalar(const TransformBatch &batch, const mat4x4 *view_projection, mat4x4 *out, size_t stride)
+{
+    compose_scalar(arrays_of(batch), 0, batch.size(), view_projection, out, stride);
+}
+
+const char *transform_batch_isa()
+{
+#if defined(TRANSFORM_BATCH_AVX2)
+    if (cpu_has_avx2())
+        return "avx2";
+#endif
+#if defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
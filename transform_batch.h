@@ -0,0 +1,49 @@
+#ifndef TRANSFORM_BATCH_H
+#define TRANSFORM_BATCH_H
+
+#include <cstddef>
+#include <vector>
+
+// Linmath
+#include "deps/linmath.h"
+
+// Euler rotation, translation and uniform scale of many objects, stored as one array per
+// component so the batched composers can load several objects per SIMD register
+struct TransformBatch
+{
+    std::vector<float> rotation_x, rotation_y, rotation_z;
+    std::vector<float> translation_x, translation_y, translation_z;
+    std::vector<float> scale;
+
+    size_t size() const
+    {
+        return scale.size();
+    }
+
+    void resize(size_t count);
+};
+
+// Raw view of a TransformBatch handed to the SIMD kernels
+struct TransformArrays
+{
+    const float *rotation_x, *rotation_y, *rotation_z;
+    const float *translation_x, *translation_y, *translation_z;
+    const float *scale;
+};
+
+// Writes, for every object i, the same matrix as the linmath sequence
+//   mat4x4_translate(M, tx, ty, tz);
+//   mat4x4_rotate_X(M, M, rx); mat4x4_rotate_Y(M, M, ry); mat4x4_rotate_Z(M, M, rz);
+//   mat4x4_scale_aniso(M, M, s, s, s);
+// premultiplied by view_projection when it is given. Matrices are written stride bytes
+// apart so they can land directly inside interleaved instance data.
+// Uses AVX2+FMA or SSE2 when available; results match linmath to within ~1e-6.
+void compose_transforms(const TransformBatch &batch, const mat4x4 *view_projection, mat4x4 *out, size_t stride = sizeof(mat4x4));
+
+// Same as compose_transforms but always on the scalar path, for reference and comparison
+void compose_transforms_scalar(const TransformBatch &batch, const mat4x4 *view_projection, mat4x4 *out, size_t stride = sizeof(mat4x4));
+
+// Name of the code path compose_transforms picks on this CPU: "avx2", "sse2" or "scalar"
+const char *transform_batch_isa();
+
+#endif
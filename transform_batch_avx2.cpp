@@ -0,0 +1,81 @@
+// AVX2+FMA instantiation of the transform kernel. Everything in this file is compiled for
+// AVX2, so it must only be entered after the runtime CPU check in transform_batch.cpp and
+// must not define anything other translation units could share (hence the anonymous namespace).
+#if defined(__x86_64__) || defined(__i386__)
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC target("avx2,fma")
+#endif
+
+#include <immintrin.h>
+
+#include "transform_batch_kernel.h"
+
+namespace
+{
+
+struct AvxOps
+{
+    typedef __m256 F;
+    typedef __m256i I;
+    static const int WIDTH = 8;
+
+    static F load(const float *p) { return _mm256_loadu_ps(p); }
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F madd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+    static F and_(F a, F b) { return _mm256_and_ps(a, b); }
+    static F andnot(F a, F b) { return _mm256_andnot_ps(a, b); }
+    static F xor_(F a, F b) { return _mm256_xor_ps(a, b); }
+    static F select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+
+    static I iset1(int v) { return _mm256_set1_epi32(v); }
+    static I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+    static I isub(I a, I b) { return _mm256_sub_epi32(a, b); }
+    static I iand(I a, I b) { return _mm256_and_si256(a, b); }
+    static I iandnot(I a, I b) { return _mm256_andnot_si256(a, b); }
+    static I icmpeq(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+    static I slli29(I a) { return _mm256_slli_epi32(a, 29); }
+    static I cvtt(F a) { return _mm256_cvttps_epi32(a); }
+    static F cvt(I a) { return _mm256_cvtepi32_ps(a); }
+    static F cast(I a) { return _mm256_castsi256_ps(a); }
+
+    // Each 8-lane register is split into two 4x4 transposes
+    static void store_matrices(F m[4][4], mat4x4 *out, size_t first, size_t stride)
+    {
+        for (int half = 0; half < 2; half++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                __m128 r0 = half ? _mm256_extractf128_ps(m[c][0], 1) : _mm256_castps256_ps128(m[c][0]);
+                __m128 r1 = half ? _mm256_extractf128_ps(m[c][1], 1) : _mm256_castps256_ps128(m[c][1]);
+                __m128 r2 = half ? _mm256_extractf128_ps(m[c][2], 1) : _mm256_castps256_ps128(m[c][2]);
+                __m128 r3 = half ? _mm256_extractf128_ps(m[c][3], 1) : _mm256_castps256_ps128(m[c][3]);
+                _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+                size_t base = first + half * 4;
+                _mm_storeu_ps((*(mat4x4 *)((char *)out + (base + 0) * stride))[c], r0);
+                _mm_storeu_ps((*(mat4x4 *)((char *)out + (base + 1) * stride))[c], r1);
+                _mm_storeu_ps((*(mat4x4 *)((char *)out + (base + 2) * stride))[c], r2);
+                _mm_storeu_ps((*(mat4x4 *)((char *)out + (base + 3) * stride))[c], r3);
+            }
+        }
+    }
+};
+
+} // namespace
+
+size_t compose_transforms_avx2(const TransformArrays &in, size_t count, const mat4x4 *view_projection, mat4x4 *out, size_t stride)
+{
+    return transform_kernel::compose<AvxOps>(in, count, view_projection, out, stride);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
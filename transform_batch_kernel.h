@@ -0,0 +1,125 @@
+#ifndef TRANSFORM_BATCH_KERNEL_H
+#define TRANSFORM_BATCH_KERNEL_H
+
+// SIMD kernel shared by the SSE2 and AVX2 translation units. Ops provides the register
+// type F (Ops::WIDTH floats), its integer counterpart I and the primitive operations.
+// Only include this from files that compile it for a single instruction set.
+
+#include "transform_batch.h"
+
+namespace transform_kernel
+{
+
+// Cephes-style sincosf: range reduction by pi/4 then minimax polynomials, ~1e-7 abs error
+template <class Ops>
+inline void sincos(typename Ops::F x, typename Ops::F &sin_out, typename Ops::F &cos_out)
+{
+    typedef typename Ops::F F;
+    typedef typename Ops::I I;
+
+    F sign_mask = Ops::set1(-0.0f);
+    F sign_sin = Ops::and_(x, sign_mask);
+    x = Ops::andnot(sign_mask, x);
+
+    // Octant j rounded up to even, so x lands in [-pi/4, pi/4] after reduction
+    I j = Ops::cvtt(Ops::mul(x, Ops::set1(1.27323954473516f)));
+    j = Ops::iand(Ops::iadd(j, Ops::iset1(1)), Ops::iset1(~1));
+    F y = Ops::cvt(j);
+
+    F swap_sign_sin = Ops::cast(Ops::slli29(Ops::iand(j, Ops::iset1(4))));
+    F sign_cos = Ops::cast(Ops::slli29(Ops::iandnot(Ops::isub(j, Ops::iset1(2)), Ops::iset1(4))));
+    F use_sin_poly = Ops::cast(Ops::icmpeq(Ops::iand(j, Ops::iset1(2)), Ops::iset1(0)));
+    sign_sin = Ops::xor_(sign_sin, swap_sign_sin);
+
+    x = Ops::madd(y, Ops::set1(-0.78515625f), x);
+    x = Ops::madd(y, Ops::set1(-2.4187564849853515625e-4f), x);
+    x = Ops::madd(y, Ops::set1(-3.77489497744594108e-8f), x);
+
+    F z = Ops::mul(x, x);
+
+    F cos_poly = Ops::madd(Ops::set1(2.443315711809948e-5f), z, Ops::set1(-1.388731625493765e-3f));
+    cos_poly = Ops::madd(cos_poly, z, Ops::set1(4.166664568298827e-2f));
+    cos_poly = Ops::mul(Ops::mul(cos_poly, z), z);
+    cos_poly = Ops::add(Ops::madd(z, Ops::set1(-0.5f), cos_poly), Ops::set1(1.0f));
+
+    F sin_poly = Ops::madd(Ops::set1(-1.9515295891e-4f), z, Ops::set1(8.3321608736e-3f));
+    sin_poly = Ops::madd(sin_poly, z, Ops::set1(-1.6666654611e-1f));
+    sin_poly = Ops::madd(Ops::mul(sin_poly, z), x, x);
+
+    sin_out = Ops::xor_(Ops::select(use_sin_poly, sin_poly, cos_poly), sign_sin);
+    cos_out = Ops::xor_(Ops::select(use_sin_poly, cos_poly, sin_poly), sign_cos);
+}
+
+// Composes Ops::WIDTH matrices per iteration over [0, count - count % WIDTH) and
+// returns the number of objects processed; the caller finishes the tail.
+template <class Ops>
+inline size_t compose(const TransformArrays &in, size_t count, const mat4x4 *view_projection, mat4x4 *out, size_t stride)
+{
+    typedef typename Ops::F F;
+    size_t simd_count = count - count % Ops::WIDTH;
+
+    for (size_t i = 0; i < simd_count; i += Ops::WIDTH)
+    {
+        F sx, cx, sy, cy, sz, cz;
+        sincos<Ops>(Ops::load(in.rotation_x + i), sx, cx);
+        sincos<Ops>(Ops::load(in.rotation_y + i), sy, cy);
+        sincos<Ops>(Ops::load(in.rotation_z + i), sz, cz);
+        F s = Ops::load(in.scale + i);
+
+        // Rows of Rx * Ry * Rz in linmath's sign convention
+        F b[3][3];
+        F sx_sy = Ops::mul(sx, sy), cx_sy = Ops::mul(cx, sy);
+        b[0][0] = Ops::mul(cy, cz);
+        b[0][1] = Ops::sub(Ops::set1(0.0f), Ops::mul(cy, sz));
+        b[0][2] = Ops::sub(Ops::set1(0.0f), sy);
+        b[1][0] = Ops::madd(cx, sz, Ops::sub(Ops::set1(0.0f), Ops::mul(sx_sy, cz)));
+        b[1][1] = Ops::madd(sx_sy, sz, Ops::mul(cx, cz));
+        b[1][2] = Ops::sub(Ops::set1(0.0f), Ops::mul(sx, cy));
+        b[2][0] = Ops::madd(cx_sy, cz, Ops::mul(sx, sz));
+        b[2][1] = Ops::sub(Ops::mul(sx, cz), Ops::mul(cx_sy, sz));
+        b[2][2] = Ops::mul(cx, cy);
+
+        // Model matrix in linmath layout m[column][row]
+        F m[4][4];
+        for (int c = 0; c < 3; c++)
+        {
+            for (int r = 0; r < 3; r++)
+                m[c][r] = Ops::mul(b[r][c], s);
+            m[c][3] = Ops::set1(0.0f);
+        }
+        m[3][0] = Ops::load(in.translation_x + i);
+        m[3][1] = Ops::load(in.translation_y + i);
+        m[3][2] = Ops::load(in.translation_z + i);
+        m[3][3] = Ops::set1(1.0f);
+
+        if (view_projection)
+        {
+            // out[c][r] = sum_k vp[k][r] * m[c][k], with vp broadcast across lanes
+            const mat4x4 &vp = *view_projection;
+            F result[4][4];
+            for (int c = 0; c < 4; c++)
+            {
+                for (int r = 0; r < 4; r++)
+                {
+                    F sum = Ops::mul(Ops::set1(vp[0][r]), m[c][0]);
+                    sum = Ops::madd(Ops::set1(vp[1][r]), m[c][1], sum);
+                    sum = Ops::madd(Ops::set1(vp[2][r]), m[c][2], sum);
+                    if (c == 3)
+                        sum = Ops::add(sum, Ops::set1(vp[3][r]));
+                    result[c][r] = sum;
+                }
+            }
+            Ops::store_matrices(result, out, i, stride);
+        }
+        else
+        {
+            Ops::store_matrices(m, out, i, stride);
+        }
+    }
+
+    return simd_count;
+}
+
+} // namespace transform_kernel
+
+#endif
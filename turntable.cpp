@@ -0,0 +1,202 @@
+#include "turntable.h"
+
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool read_turntable_script(const std::string &filename, std::vector<TurntablePose> &poses)
+{
+    std::ifstream script(filename);
+    if (!script.is_open())
+    {
+        std::cout << "Cannot open turntable script " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    int last_frame = -1;
+    TurntablePose last = {};
+    while (std::getline(script, line))
+    {
+        line_number++;
+        std::istringstream in(line);
+        std::string first;
+        if (!(in >> first) || first[0] == '#')
+            continue;
+
+        int frame;
+        std::from_chars_result parsed = std::from_chars(first.data(), first.data() + first.size(), frame);
+        if (parsed.ec != std::errc() || parsed.ptr != first.data() + first.size())
+        {
+            std::cout << filename << ":" << line_number << ": frame number expected, got \"" << first << "\"" << std::endl;
+            return false;
+        }
+        TurntablePose key;
+        if (!(in >> key.rotation[0] >> key.rotation[1] >> key.rotation[2] >> key.rotation_camera_y >> key.zoom))
+        {
+            std::cout << filename << ":" << line_number
+                      << ": expected <frame> <rotationX> <rotationY> <rotationZ> <rotationCameraY> <zoom>" << std::endl;
+            return false;
+        }
+        if (frame <= last_frame || (last_frame < 0 && frame != 0))
+        {
+            std::cout << filename << ":" << line_number << ": frame numbers must start at 0 and increase" << std::endl;
+            return false;
+        }
+
+        // Frames after the previous keyframe, up to and including this one
+        if (last_frame < 0)
+            last = key;
+        for (int f = last_frame + 1; f <= frame; f++)
+        {
+            float t = (float)(f - last_frame) / (frame - last_frame);
+            auto blend = [t](float from, float to) { return from + (to - from) * t; };
+            TurntablePose pose;
+            for (int axis = 0; axis < 3; axis++)
+                pose.rotation[axis] = blend(last.rotation[axis], key.rotation[axis]);
+            pose.rotation_camera_y = blend(last.rotation_camera_y, key.rotation_camera_y);
+            pose.zoom = blend(last.zoom, key.zoom);
+            poses.push_back(pose);
+        }
+        last_frame = frame;
+        last = key;
+    }
+
+    if (poses.empty())
+    {
+        std::cout << filename << ": no keyframes" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool turntable_filename(const std::string &pattern, int frame, std::string &filename)
+{
+    size_t percent = pattern.find('%');
+    if (percent == std::string::npos)
+        return false;
+
+    size_t end = percent + 1;
+    while (end < pattern.size() && isdigit((unsigned char)pattern[end]))
+        end++;
+    if (end == pattern.size() || pattern[end] != 'd' || pattern.find('%', end) != std::string::npos)
+        return false;
+
+    // "%04d": a leading zero pads with zeros, the digits give the width
+    std::string spec = pattern.substr(percent + 1, end - percent - 1);
+    std::string number = std::to_string(frame);
+    size_t width = spec.empty() ? 0 : (size_t)atoi(spec.c_str());
+    if (number.size() < width)
+        number.insert(0, width - number.size(), spec[0] == '0' ? '0' : ' ');
+
+    filename = pattern.substr(0, percent) + number + pattern.substr(end + 1);
+    return true;
+}
+
+void ReadbackRing::init(GLsizei frame_width, GLsizei frame_height, int slot_count)
+{
+    width = frame_width;
+    height = frame_height;
+    slots.resize(slot_count);
+    oldest = pending = 0;
+
+    // GL_STREAM_READ: written by the GPU once, read by the CPU once
+    for (Slot &slot : slots)
+    {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void ReadbackRing::destroy()
+{
+    for (Slot &slot : slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    slots.clear();
+    pending = 0;
+}
+
+void ReadbackRing::start(int frame)
+{
+    Slot &slot = slots[(oldest + pending) % slots.size()];
+    slot.frame = frame;
+
+    // With a pack buffer bound, glReadPixels takes an offset and returns without waiting
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pending++;
+    frames++;
+}
+
+ReadbackStatus ReadbackRing::collect(std::vector<uint32_t> &pixels, int &frame, bool block)
+{
+    if (pending == 0)
+        return READBACK_NOT_READY;
+
+    Slot &slot = slots[oldest];
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        if (!block)
+            return READBACK_NOT_READY;
+
+        auto wait_start = std::chrono::steady_clock::now();
+        waits++;
+        do
+        {
+            status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while (status == GL_TIMEOUT_EXPIRED);
+        wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    auto copy_start = std::chrono::steady_clock::now();
+    size_t size = (size_t)width * height;
+    pixels.resize(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void *mapping = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size * 4, GL_MAP_READ_BIT);
+    if (mapping)
+    {
+        memcpy(pixels.data(), mapping, size * 4);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    copy_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - copy_start).count();
+
+    frame = slot.frame;
+    oldest = (oldest + 1) % slots.size();
+    pending--;
+    if (!mapping)
+    {
+        std::cout << "Cannot map the pixel buffer of frame " << frame << std::endl;
+        failures++;
+        return READBACK_FAILED;
+    }
+    return READBACK_READY;
+}
+
+void ReadbackRing::print_stats() const
+{
+    std::cout << "Readback ring (" << slots.size() << " pixel buffers): " << frames << " frames, " << waits
+              << " fence waits (" << wait_ms << " ms total), " << (frames > 0 ? copy_ms / frames : 0)
+              << " ms per frame to map and copy";
+    if (failures > 0)
+        std::cout << ", " << failures << " failed";
+    std::cout << std::endl;
+}
@@ -0,0 +1,79 @@
+#ifndef TURNTABLE_H
+#define TURNTABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// GLEW
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// View of one turntable frame: the values the arrow keys, C/V and W/S drive in the window
+struct TurntablePose
+{
+    float rotation[3]; // rotationX, rotationY, rotationZ
+    float rotation_camera_y;
+    float zoom;
+};
+
+// Reads a turntable script: one "<frame> <rotationX> <rotationY> <rotationZ> <rotationCameraY>
+// <zoom>" keyframe per line, '#' comments, frame numbers increasing from 0. Frames between
+// two keyframes are interpolated linearly, so poses receives one entry per frame up to the last.
+bool read_turntable_script(const std::string &filename, std::vector<TurntablePose> &poses);
+
+// Fills in the single %d (optionally zero padded, e.g. %04d) of pattern with frame.
+// Returns false if pattern has no such field or another '%'.
+bool turntable_filename(const std::string &pattern, int frame, std::string &filename);
+
+// Outcome of ReadbackRing::collect()
+enum ReadbackStatus
+{
+    READBACK_NOT_READY, // nothing queued, or the oldest frame is still on the GPU
+    READBACK_READY,     // the oldest frame was copied out
+    READBACK_FAILED,    // the oldest frame's buffer could not be mapped; the frame is lost
+};
+
+// Asynchronous glReadPixels through a ring of pixel pack buffers. start() only queues the
+// copy of the bound read framebuffer and places a fence after it; the frame is mapped a
+// few frames later by collect(), once the GPU has long finished, so reading back never
+// stalls the pipeline unless every buffer is still in flight.
+struct ReadbackRing
+{
+    // Counters, see print_stats()
+    long frames = 0;
+    long waits = 0;      // collect() had to block on a fence
+    long failures = 0;   // frames whose buffer could not be mapped
+    double wait_ms = 0;
+    double copy_ms = 0;  // mapping and copying out finished frames
+
+    void init(GLsizei width, GLsizei height, int slot_count);
+    void destroy();
+
+    bool full() const { return pending == (int)slots.size(); }
+
+    // Queues the read of the current frame, tagged with frame. Needs a free slot (!full()).
+    void start(int frame);
+
+    // Copies out the oldest queued frame into pixels (width x height RGBA, bottom row first).
+    // Without block it only does so if the GPU has already finished it. frame is set for
+    // READBACK_READY and READBACK_FAILED; either way the slot is free again.
+    ReadbackStatus collect(std::vector<uint32_t> &pixels, int &frame, bool block);
+
+    void print_stats() const;
+
+private:
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        int frame = 0;
+    };
+
+    std::vector<Slot> slots;
+    GLsizei width = 0, height = 0;
+    int oldest = 0;
+    int pending = 0;
+};
+
+#endif
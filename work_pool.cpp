@@ -0,0 +1,144 @@
+#include "work_pool.h"
+
+static uint64_t pack_range(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+WorkPool::~WorkPool()
+{
+    stop();
+}
+
+void WorkPool::start(unsigned thread_count)
+{
+    if (thread_count == 0)
+        thread_count = 1;
+
+    slices = std::vector<Slice>(thread_count);
+    quitting = false;
+    for (unsigned i = 1; i < thread_count; i++)
+        threads.emplace_back(&WorkPool::worker, this, i);
+}
+
+void WorkPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    start_signal.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+void WorkPool::parallel_for(size_t count, const std::function<void(size_t, unsigned)> &body)
+{
+    if (count == 0)
+        return;
+
+    unsigned workers = size();
+    for (unsigned i = 0; i < workers; i++)
+    {
+        uint32_t begin = (uint32_t)(count * i / workers);
+        uint32_t end = (uint32_t)(count * (i + 1) / workers);
+        slices[i].range.store(pack_range(begin, end), std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &body;
+        busy = workers - 1;
+        generation++;
+    }
+    start_signal.notify_all();
+
+    run_slices(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_signal.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+}
+
+void WorkPool::worker(unsigned index)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_signal.wait(lock, [&] { return quitting || generation != seen; });
+            if (quitting)
+                return;
+            seen = generation;
+        }
+
+        run_slices(index);
+
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = --busy == 0;
+        }
+        if (last)
+            done_signal.notify_one();
+    }
+}
+
+void WorkPool::run_slices(unsigned index)
+{
+    const std::function<void(size_t, unsigned)> &body = *job;
+    uint32_t item;
+    for (;;)
+    {
+        while (take(index, item))
+            body(item, index);
+        if (!steal(index))
+            return;
+    }
+}
+
+bool WorkPool::take(unsigned index, uint32_t &item)
+{
+    std::atomic<uint64_t> &range = slices[index].range;
+    uint64_t current = range.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        uint32_t begin = (uint32_t)current, end = (uint32_t)(current >> 32);
+        if (begin >= end)
+            return false;
+        if (range.compare_exchange_weak(current, pack_range(begin + 1, end), std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            item = begin;
+            return true;
+        }
+    }
+}
+
+bool WorkPool::steal(unsigned index)
+{
+    // Visit the others starting after this worker, so thieves spread over different victims
+    unsigned workers = size();
+    for (unsigned offset = 1; offset < workers; offset++)
+    {
+        std::atomic<uint64_t> &victim = slices[(index + offset) % workers].range;
+        uint64_t current = victim.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            uint32_t begin = (uint32_t)current, end = (uint32_t)(current >> 32);
+            if (begin >= end)
+                break;
+
+            uint32_t split = end - (end - begin + 1) / 2;
+            if (victim.compare_exchange_weak(current, pack_range(begin, split), std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                // Nobody else writes an empty slice, so a plain store hands the loot over
+                slices[index].range.store(pack_range(split, end), std::memory_order_relaxed);
+                steal_count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for data-parallel loops. parallel_for() hands every worker an
+// equal slice of the item range; a worker that runs out steals the back half of another
+// worker's remaining slice, so uneven items (screen tiles with many triangles) balance
+// out without a shared queue. Slices are a packed [begin, end) pair updated by
+// compare-and-swap, no locks on the item path.
+struct WorkPool
+{
+    WorkPool() = default;
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+    ~WorkPool();
+
+    // thread_count includes the thread calling parallel_for(), which works as worker 0
+    void start(unsigned thread_count);
+    void stop();
+
+    unsigned size() const { return (unsigned)slices.size(); }
+
+    // Calls body(item, worker) for every item in [0, count) and returns once all are done.
+    // worker is in [0, size()) and identifies the calling thread for per-worker scratch data.
+    void parallel_for(size_t count, const std::function<void(size_t, unsigned)> &body);
+
+    // Ranges taken from another worker, over the pool's lifetime
+    long steals() const { return steal_count.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Slice
+    {
+        std::atomic<uint64_t> range{0}; // begin in the low 32 bits, end in the high 32 bits
+    };
+
+    std::vector<Slice> slices;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_signal, done_signal;
+    const std::function<void(size_t, unsigned)> *job = nullptr;
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool quitting = false;
+    std::atomic<long> steal_count{0};
+
+    void worker(unsigned index);
+    void run_slices(unsigned index);
+    bool take(unsigned index, uint32_t &item);
+    bool steal(unsigned index);
+};
+
+#endif